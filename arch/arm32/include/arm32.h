@@ -51,6 +51,13 @@
 #define SCR_NS		(1 << 0)
 #define SCR_FIQ		(1 << 2)
 
+#define CNTP_CTL_ENABLE		(1 << 0)
+#define CNTP_CTL_IMASK		(1 << 1)
+#define CNTP_CTL_ISTATUS	(1 << 2)
+
+#define PMCR_E			(1 << 0)
+#define PMCNTENSET_C		0x80000000
+
 #define SCTLR_M		(1 << 0)
 #define SCTLR_A		(1 << 1)
 #define SCTLR_C		(1 << 2)
@@ -74,6 +81,25 @@ static inline uint32_t read_mpidr(void)
 	return mpidr;
 }
 
+/* TPIDRPRW is banked, the secure copy holds the per-CPU data pointer */
+static inline uint32_t read_tpidrprw(void)
+{
+	uint32_t tpidrprw;
+
+	asm ("mrc	p15, 0, %[tpidrprw], c13, c0, 4"
+			: [tpidrprw] "=r" (tpidrprw)
+	);
+
+	return tpidrprw;
+}
+
+static inline void write_tpidrprw(uint32_t tpidrprw)
+{
+	asm ("mcr	p15, 0, %[tpidrprw], c13, c0, 4"
+			: : [tpidrprw] "r" (tpidrprw)
+	);
+}
+
 static inline uint32_t read_sctlr(void)
 {
 	uint32_t sctlr;
@@ -116,12 +142,127 @@ static inline void dsb(void)
 	asm ("dsb");
 }
 
+static inline void dmb(void)
+{
+	asm ("dmb" : : : "memory");
+}
+
+static inline void sev(void)
+{
+	asm ("sev");
+}
+
 static inline void write_tlbiallis(void)
 {
 	/* Invalidate entire unified TLB Inner Shareable, r0 ignored */
 	asm ("mcr	p15, 0, r0, c8, c3, 0");
 }
 
+static inline void write_tlbimvaais(uint32_t mva)
+{
+	/*
+	 * Invalidate unified TLB by MVA, all ASID, Inner Shareable, the
+	 * page offset bits are ignored
+	 */
+	asm ("mcr	p15, 0, %[mva], c8, c3, 3" : : [mva] "r" (mva));
+}
+
+static inline void write_ats1cpr(uint32_t va)
+{
+	/* Translate va as a PL1 read of the current security state */
+	asm ("mcr	p15, 0, %[va], c7, c8, 0" : : [va] "r" (va));
+}
+
+static inline uint32_t read_par(void)
+{
+	uint32_t par;
+
+	asm ("mrc	p15, 0, %[par], c7, c4, 0" : [par] "=r" (par));
+
+	return par;
+}
+
+static inline void write_dccimvac(uint32_t va)
+{
+	/* Clean and invalidate data cache line by MVA to PoC */
+	asm ("mcr	p15, 0, %[va], c7, c14, 1"
+			: : [va] "r" (va)
+	);
+}
+
+static inline uint32_t read_cntfrq(void)
+{
+	uint32_t frq;
+
+	asm ("mrc	p15, 0, %[frq], c14, c0, 0"
+			: [frq] "=r" (frq)
+	);
+
+	return frq;
+}
+
+/* Accesses the secure physical timer when executed in secure state */
+static inline void write_cntp_tval(uint32_t tval)
+{
+	asm ("mcr	p15, 0, %[tval], c14, c2, 0"
+			: : [tval] "r" (tval)
+	);
+}
+
+static inline void write_cntp_ctl(uint32_t ctl)
+{
+	asm ("mcr	p15, 0, %[ctl], c14, c2, 1"
+			: : [ctl] "r" (ctl)
+	);
+}
+
+static inline uint32_t read_pmcr(void)
+{
+	uint32_t pmcr;
+
+	asm ("mrc	p15, 0, %[pmcr], c9, c12, 0"
+			: [pmcr] "=r" (pmcr)
+	);
+
+	return pmcr;
+}
+
+static inline void write_pmcr(uint32_t pmcr)
+{
+	asm ("mcr	p15, 0, %[pmcr], c9, c12, 0"
+			: : [pmcr] "r" (pmcr)
+	);
+}
+
+static inline void write_pmcntenset(uint32_t pmcntenset)
+{
+	asm ("mcr	p15, 0, %[pmcntenset], c9, c12, 1"
+			: : [pmcntenset] "r" (pmcntenset)
+	);
+}
+
+static inline uint32_t read_pmccntr(void)
+{
+	uint32_t pmccntr;
+
+	asm volatile ("mrc	p15, 0, %[pmccntr], c9, c13, 0"
+			: [pmccntr] "=r" (pmccntr)
+	);
+
+	return pmccntr;
+}
+
+static inline uint32_t read_sp(void)
+{
+	uint32_t sp;
+
+	asm volatile ("mov	%[sp], sp"
+			: [sp] "=r" (sp)
+	);
+
+	return sp;
+}
+
 static inline uint32_t read_cpsr(void)
 {
 	uint32_t cpsr;
@@ -27,8 +27,55 @@
 #ifndef KERN_ARCH_DEBUG_H
 #define KERN_ARCH_DEBUG_H
 
+#include <kern/kern.h>
+
+#ifdef WITH_STACK_CANARIES
+#define STACK_CANARY_SIZE	(4 * sizeof(uint32_t))
+#define START_CANARY_VALUE	0xdededede
+#define END_CANARY_VALUE	0xabababab
+/* Unused parts of the stacks are painted to track maximum usage */
+#define STACK_PAINT_VALUE	0xcdcdcdcd
+#else
+#define STACK_CANARY_SIZE	0
+#endif
+
+/*
+ * With WITH_STACK_GUARD_PAGES each stack is preceded by an unmapped page
+ * so an overflow is caught by a data abort. Stacks are then rounded up
+ * to a multiple of the page size.
+ */
+#ifdef WITH_STACK_GUARD_PAGES
+#define STACK_GUARD_SIZE	4096	/* One small page */
+#define STACK_SLOT_SIZE(size) \
+	(STACK_GUARD_SIZE + ROUNDUP((size) + STACK_CANARY_SIZE, STACK_GUARD_SIZE))
+#else
+#define STACK_GUARD_SIZE	0
+#define STACK_SLOT_SIZE(size)	((size) + STACK_CANARY_SIZE)
+#endif
+
 void check_canaries(void);
 
+#ifdef WITH_STACK_CANARIES
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Paints the words in [start, end) with STACK_PAINT_VALUE. If the
+ * current stack pointer is inside the range, words at or above it are
+ * left untouched.
+ */
+void stack_paint(uint32_t *start, uint32_t *end);
+
+/* Returns the maximum number of bytes ever used of [start, end) */
+size_t stack_max_usage(const uint32_t *start, const uint32_t *end);
+#endif
+
+/* Prints the maximum usage of all stacks */
+void print_stack_usage(void);
+
+/* Prints the cycle statistics collected by the threads, if enabled */
+void print_stats(void);
+
 #endif /*KERN_ARCH_DEBUG_H*/
 
 
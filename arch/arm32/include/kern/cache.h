@@ -27,6 +27,21 @@
 #ifndef CACHE_H
 #define CACHE_H
 
+#include <sys/types.h>
+
 void cache_tlb_invalidate(void);
 
+/*
+ * Invalidates the TLB entries translating [va, va + len) on all cores in
+ * the inner shareable domain, one entry each stride bytes where stride
+ * is the smallest mapping size used in the range before the update.
+ * Completes any pending translation table updates first and waits for
+ * the invalidation to complete once. Large ranges fall back to
+ * cache_tlb_invalidate().
+ */
+void cache_tlb_invalidate_range(vaddr_t va, size_t len, size_t stride);
+
+/* Cleans and invalidates the data cache lines covering [va, va + len) */
+void cache_dcache_clean_inv_range(vaddr_t va, size_t len);
+
 #endif /*CACHE_H*/
@@ -29,23 +29,123 @@
 
 #include <sys/types.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 void mmu_init(uint32_t *l1_table, uintptr_t code_start, uintptr_t code_end,
 	uintptr_t data_start, uintptr_t data_end);
 
+/*
+ * Enables the MMU of the calling CPU with the tables of mmu_init(),
+ * called by secondary CPUs once mmu_init() is done.
+ */
+void mmu_enable(void);
+
 vaddr_t mmu_map_device(paddr_t addr, size_t len);
 
 vaddr_t mmu_map_rwmem(paddr_t addr, size_t len, bool ns);
 
-/* TODO update these with actual lookup */
-static inline paddr_t mmu_virt_to_phys(vaddr_t va)
-{
-	return va;
-}
+/*
+ * Cache policies of normal memory, in the encoding used for the inner
+ * policy in the C and B bits with TEX[2] set.
+ */
+#define MMU_CACHE_NONCACHE	0x0
+#define MMU_CACHE_WBWA		0x1
+#define MMU_CACHE_WT		0x2
+#define MMU_CACHE_WB		0x3
+
+/*
+ * Maps the sections covering [addr, addr + len) as non-secure normal
+ * memory with the supplied inner and outer cache policies, MMU_CACHE_*.
+ */
+vaddr_t mmu_map_ns_mem(paddr_t addr, size_t len, uint32_t inner,
+		uint32_t outer);
+
+#define MMU_PAGE_SIZE		0x1000
+
+/* Attributes of small pages, normal memory RW executable if 0 */
+#define MMU_ATTR_RO		(1 << 0)
+#define MMU_ATTR_XN		(1 << 1)
+#define MMU_ATTR_DEVICE		(1 << 2)
+#define MMU_ATTR_NS		(1 << 3)
 
-static inline vaddr_t mmu_phys_to_virt(paddr_t pa)
-{
-	return pa;
-}
+/*
+ * The functions below work at MMU_PAGE_SIZE granularity, the range is
+ * expanded to whole pages. A section mapping part of the range is split
+ * into small pages with a second level table from a pool of
+ * MMU_L2_NUM_TABLES tables. All pages in a section have the same
+ * MMU_ATTR_NS since it's a property of the second level table. Mapped
+ * sections are only split before the MMU is enabled, see mmu_init(),
+ * once it's enabled only unmapped sections get a table.
+ *
+ * Returns false, without changing any page, if a second level table
+ * can't be had, the section is mapped and the MMU enabled, or the NS
+ * attribute doesn't match the section.
+ *
+ * All functions updating the translation tables serialize on a lock
+ * taken with IRQ and FIQ masked, so they can be called from fastcalls.
+ */
+
+/* Maps [va, va + len) to [pa, pa + len) with MMU_ATTR_* in attrs */
+bool mmu_map_pages(vaddr_t va, paddr_t pa, size_t len, uint32_t attrs);
+
+/* Unmaps [va, va + len), returns false if not mapped */
+bool mmu_unmap_pages(vaddr_t va, size_t len);
+
+/*
+ * Replaces the MMU_ATTR_* of the pages mapping [va, va + len) keeping
+ * the physical addresses, returns false if not mapped
+ */
+bool mmu_set_page_attrs(vaddr_t va, size_t len, uint32_t attrs);
+
+/*
+ * Unmaps the small page at va to catch stack overflows, any access to
+ * the page results in a data abort. The section mapping va is split
+ * into small pages if needed.
+ *
+ * Returns false if va isn't mapped or if no second level table is
+ * available.
+ */
+bool mmu_map_guard_page(vaddr_t va);
+
+/*
+ * Per-CPU cache of recent translations, direct mapped on the section
+ * and page number respectively. An entry is only valid if gen matches
+ * the current generation, which changes with each mapping update.
+ */
+#define MMU_XLAT_CACHE_SIZE	16
+
+struct mmu_xlat_entry {
+	vaddr_t va;
+	paddr_t pa;
+	bool ns;
+	uint32_t gen;
+};
+
+struct mmu_xlat_cache {
+	struct mmu_xlat_entry sections[MMU_XLAT_CACHE_SIZE];
+	struct mmu_xlat_entry pages[MMU_XLAT_CACHE_SIZE];
+};
+
+/*
+ * Returns the physical address va is mapped to, or 0 if va isn't
+ * mapped. Misses in the translation cache are translated with ATS1CPR.
+ */
+paddr_t mmu_virt_to_phys(vaddr_t va);
+
+/*
+ * Returns a virtual address mapping pa, or 0 if pa isn't mapped.
+ * Identity mappings are found through mmu_virt_to_phys(), anything
+ * else by searching the translation tables. Secure and non-secure
+ * physical addresses aren't told apart, use mmu_ns_phys_to_virt() for
+ * addresses supplied by normal world.
+ */
+vaddr_t mmu_phys_to_virt(paddr_t pa);
+
+/*
+ * Returns a virtual address mapping the non-secure range [pa, pa + len)
+ * contiguously, or 0 unless every page of the range is mapped as
+ * non-secure memory. len 0 is checked as one byte.
+ */
+vaddr_t mmu_ns_phys_to_virt(paddr_t pa, size_t len);
 
 #endif /*MMU_H*/
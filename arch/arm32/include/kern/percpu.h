@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2014, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef KERN_PERCPU_H
+#define KERN_PERCPU_H
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <arm32.h>
+#include <plat.h>
+#include <sm/sm.h>
+#include <kern/thread.h>
+#include <kern/mmu.h>
+#include <kern/percpu_defs.h>
+
+struct thread_core_local {
+	vaddr_t tmp_stack_va_end;
+	int curr_thread;
+	bool preempt_pending;
+};
+
+/*
+ * Data private to one CPU. Each instance is aligned to a cache line to
+ * avoid false sharing between cores. The secure copy of TPIDRPRW points
+ * to the instance of the current CPU.
+ */
+struct percpu {
+	struct sm_nsec_ctx sm_nsec_ctx;
+	struct sm_sec_ctx sm_sec_ctx;
+	struct thread_core_local thread_core_local;
+	uint32_t fiq_entry_cycles;	/* PMCCNTR at sm_fiq_entry */
+	struct thread_fiq_latency_stats fiq_latency;
+	struct thread_cycle_stats rpc_suspend;
+	struct thread_cycle_stats rpc_resume;
+	struct mmu_xlat_cache mmu_xlat_cache;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+/* Called once on each CPU before any per-CPU data is used */
+void percpu_init(void);
+
+static inline struct percpu *get_percpu(void)
+{
+	return (struct percpu *)read_tpidrprw();
+}
+
+#endif /*KERN_PERCPU_H*/
@@ -28,6 +28,7 @@
 #define THREAD_H
 
 #include <sys/types.h>
+#include <sm/teesmc.h>
 
 #define THREAD_ID_0		0
 #define THREAD_ABT_STACK	0xfffffffe
@@ -121,6 +122,12 @@ struct thread_handlers {
 };
 void thread_init_handlers(const struct thread_handlers *handlers);
 
+/*
+ * Installs the thread vector on a secondary CPU, the handlers are set
+ * by thread_init_handlers() on the primary CPU.
+ */
+void thread_init_secondary(void);
+
 /*
  * Sets the stacks to be used by the different threads. Use THREAD_ID_0 for
  * first stack, THREAD_ID_0 + 1 for the next and so on.
@@ -134,6 +141,104 @@ void thread_init_handlers(const struct thread_handlers *handlers);
  */
 bool thread_init_stack(uint32_t stack_id, vaddr_t sp);
 
+/*
+ * Initializes the thread pool. Stacks of stack_size bytes for all
+ * NUM_THREADS_MAX threads are allocated from reserved memory, the first
+ * num_threads threads are made available. Further threads are made
+ * available on demand when all available threads are busy.
+ *
+ * Returns true on success and false on errors.
+ */
+bool thread_init_pool(size_t stack_size, size_t num_threads);
+
+/* Checks the canaries of the stacks allocated by the thread pool */
+void thread_check_canaries(void);
+
+/* Prints the maximum usage of the stacks allocated by the thread pool */
+void thread_print_stack_usage(void);
+
+/*
+ * Cycles consumed in secure world by completed stdcalls, counted with
+ * the PMU cycle counter while the threads are executing. Collected per
+ * TEESMC_CMD_* command and per hypervisor client ID when
+ * WITH_THREAD_CYCLE_STATS is defined.
+ */
+struct thread_cycle_stats {
+	uint64_t cycles;
+	uint32_t num_calls;
+};
+
+/* TEESMC_CMD_* and THREAD_STATS_CMD_OTHER for everything else */
+#define THREAD_STATS_CMD_OTHER	(TEESMC_CMD_CANCEL + 1)
+#define THREAD_STATS_NUM_CMDS	(THREAD_STATS_CMD_OTHER + 1)
+/* Hypervisor client IDs above the last entry are counted in the last */
+#define THREAD_STATS_NUM_CLNTS	8
+
+/* Sets the TEESMC_CMD_* the current thread is accounted to */
+void thread_set_stats_cmd(uint32_t cmd);
+
+/* Returns false if cmd is out of range or statistics are disabled */
+bool thread_get_cmd_cycle_stats(uint32_t cmd, struct thread_cycle_stats *stats);
+
+/* Returns false if statistics are disabled */
+bool thread_get_clnt_cycle_stats(uint32_t hyp_clnt_id,
+		struct thread_cycle_stats *stats);
+
+/*
+ * Cycles from entering thread_rpc() until the thread is suspended, and
+ * from the thread being resumed by normal world until thread_rpc()
+ * returns. Returns false if statistics are disabled, the stats are per
+ * CPU.
+ */
+bool thread_get_rpc_switch_stats(struct thread_cycle_stats *suspend,
+		struct thread_cycle_stats *resume);
+
+/*
+ * Cycles from the monitor receiving a FIQ from normal world until the
+ * FIQ handler is called, only collected if WITH_THREAD_CYCLE_STATS is
+ * defined.
+ */
+struct thread_fiq_latency_stats {
+	uint64_t cycles;
+	uint32_t min_cycles;
+	uint32_t max_cycles;
+	uint32_t num_fiqs;
+};
+
+/* Returns false if statistics are disabled, the stats are per CPU */
+bool thread_get_fiq_latency_stats(struct thread_fiq_latency_stats *stats);
+
+/*
+ * Handles an expired secure physical timer, to be called from the FIQ
+ * handler. If a thread is active on the current CPU it's preempted
+ * once the FIQ handler returns, see THREAD_SCHED_POLICY.
+ */
+void thread_sched_tick(void);
+
+/*
+ * Cancellation of the call executed by a thread. The current call is
+ * tagged with an id with thread_set_cancel_id(), thread_cancel() with
+ * the same id from any CPU marks the thread canceled. The thread runs
+ * until its next cancellation point, thread_rpc_alloc(),
+ * thread_rpc_cmd() and thread_rpc_cmd_regs(), which return without
+ * doing the RPC once canceled. A canceled thread suspended in normal
+ * world is resumed on the next completed stdcall, an RPC it was
+ * waiting for then fails as above.
+ *
+ * Ids are neither THREAD_CANCEL_ID_NONE nor THREAD_CANCEL_ID_CANCELED.
+ * Setting a new id, or THREAD_CANCEL_ID_NONE once the call is done,
+ * clears a cancellation of the previous call.
+ */
+#define THREAD_CANCEL_ID_NONE		0
+#define THREAD_CANCEL_ID_CANCELED	0xffffffff
+void thread_set_cancel_id(uint32_t id);
+
+/* Returns false if no thread executes a call tagged with id */
+bool thread_cancel(uint32_t id);
+
+/* Returns true if the current thread is canceled */
+bool thread_is_canceled(void);
+
 /*
  * Set Thread Specific Data (TSD) pointer together a function
  * to free the TSD on thread_exit.
@@ -151,9 +256,20 @@ void *thread_get_tsd(void);
  * @payload_size: size in bytes of payload buffers
  * @arg: returned physical pointer to struct teesmc32_arg buffer
  * @payload: returned physcial pointer to payload buffer
+ *
+ * Both pointers are returned as 0 if the allocation failed or the thread
+ * is canceled.
  */
 void thread_rpc_alloc(size_t arg_size, size_t payload_size, paddr_t *arg,
 		paddr_t *payload);
+/**
+ * Registers a region of non-secure memory which thread_rpc_alloc()
+ * sub-allocates from before asking normal world, see
+ * TEESMC32_FASTCALL_REGISTER_RPC_POOL. Returns false if the region is
+ * invalid or a pool is already registered.
+ */
+bool thread_rpc_pool_register(paddr_t pa, size_t size);
+
 /**
  * Free physical memory previously allocated with thread_rpc_alloc()
  *
@@ -166,7 +282,24 @@ void thread_rpc_free(paddr_t arg, paddr_t payload);
  * Does an RPC with a physical pointer to a struct teesmc32_arg
  *
  * @arg: physical pointer to struct teesmc32_arg
+ *
+ * Returns false if the thread is canceled
+ */
+bool thread_rpc_cmd(paddr_t arg);
+
+/**
+ * Does an RPC with the request and its parameters carried in registers,
+ * see TEESMC_RETURN_RPC_CMD_REGS
+ *
+ * @cmd: the Request ID
+ * @vals: value a and b of the first and second parameter, updated with
+ *	  the values returned by normal world
+ *
+ * Returns the return value of the request, or TEESMC_ERROR_CANCEL if
+ * the thread is canceled
  */
-void thread_rpc_cmd(paddr_t arg);
+#define THREAD_RPC_NUM_REG_VALS	4
+uint32_t thread_rpc_cmd_regs(uint32_t cmd,
+		uint32_t vals[THREAD_RPC_NUM_REG_VALS]);
 
 #endif /*THREAD_H*/
@@ -28,6 +28,25 @@
 #define THREAD_DEFS_H
 
 #define THREAD_FLAGS_COPY_ARGS_ON_RETURN	1
+/* Reclaimed canceled thread, returns reclaim_rv[] when completed */
+#define THREAD_FLAGS_RECLAIMED			2
+
+/*
+ * Banked modes used by a thread, stored in modes_used in struct
+ * thread_ctx_regs. Only the banked registers of the modes used are
+ * saved and restored when the thread is suspended and resumed. SYS and
+ * SVC mode registers are always saved and restored.
+ */
+#define THREAD_CTX_MODE_IRQ			(1 << 0)
+#define THREAD_CTX_MODE_ABT			(1 << 1)
+#define THREAD_CTX_MODE_UND			(1 << 2)
+
+/*
+ * Values for THREAD_SCHED_POLICY. A time sliced thread is only ever
+ * suspended to normal world, never switched for another secure thread.
+ */
+#define THREAD_SCHED_RUN_TO_COMPLETION		0
+#define THREAD_SCHED_TIME_SLICED		1
 
 #define THREAD_ABORT_UNDEF			0
 #define THREAD_ABORT_PREFETCH			1
@@ -32,8 +32,11 @@
 #define STACK_THREAD_SIZE	(8 * 1024)
 #define STACK_ALIGMENT		8
 
+#define CACHE_LINE_SIZE		64	/* Cortex-A15 L1/L2 line size */
+
 #define MMU_L1_NUM_ENTRIES	4096		/* Maps 4 GiB */
 #define MMU_L1_ALIGNMENT	(1 << 14)	/* 16 KiB aligned */
+#define MMU_L2_NUM_TABLES	8		/* Small page table pool */
 
 #define GIC_BASE                0x2c000000
 #define GICC_OFFSET             0x2000
@@ -48,5 +51,6 @@
 #define DDR0_SIZE		(510 * 1024 * 1024)
 
 #define IT_UART1		38
+#define IT_SEC_PHY_TIMER	29
 
 #endif /*PLAT_H*/
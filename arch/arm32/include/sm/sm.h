@@ -74,6 +74,8 @@ struct sm_sec_ctx {
 	uint32_t und_lr;
 	uint32_t mon_lr;
 	uint32_t mon_spsr;
+	/* Non-zero while serving a fastcall entered through the fast path */
+	uint32_t fastcall;
 };
 
 /* Returns storage location of non-secure context for current CPU */
@@ -38,4 +38,12 @@
 #define SM_STACK_SIZE	(24 * 4)
 #endif
 
+/*
+ * Offsets into struct sm_nsec_ctx and struct sm_sec_ctx used by the
+ * fastcall path in sm_smc_entry
+ */
+#define SM_CTX_SVC_SPSR_OFFS	(5 * 4)
+#define SM_CTX_MON_LR_OFFS	(14 * 4)
+#define SM_SEC_CTX_FASTCALL_OFFS	(16 * 4)
+
 #endif /*SM_DEFS_H*/
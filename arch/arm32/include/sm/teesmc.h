@@ -89,8 +89,40 @@
 #define TEESMC_CMD_OPEN_SESSION	0
 #define TEESMC_CMD_INVOKE_COMMAND	1
 #define TEESMC_CMD_CLOSE_SESSION	2
+/*
+ * Cancels the TEESMC_CMD_INVOKE_COMMAND in progress in the session in
+ * session, if any. The canceled call returns with ret
+ * TEESMC_ERROR_CANCEL at its next cancellation point. The cancel may
+ * also be issued with TEESMC32_FASTCALL_WITH_ARG, which works when all
+ * threads are held by calls to cancel. A call suspended in normal
+ * world is unwound by secure world when the next stdcall, normally the
+ * cancel itself, completes or finds no free thread, the latter then
+ * returns TEESMC_RETURN_EBUSY instead of TEESMC_RETURN_EWAIT. That
+ * stdcall may return RPCs of the unwound call, served and resumed as
+ * usual, before its own result. Normal world must keep the struct
+ * teesmc32_arg of the canceled call until then and a later
+ * TEESMC32_CALL_RETURN_FROM_RPC for it returns TEESMC_RETURN_ERESUME.
+ * ret of the cancel itself is TEESMC_ERROR_ITEM_NOT_FOUND if no call
+ * was in progress.
+ */
 #define TEESMC_CMD_CANCEL		3
 
+/*
+ * Origin of the return value in struct teesmc32_arg ret_origin when the
+ * command couldn't be delivered, for instance an unknown command in a
+ * batch
+ */
+#define TEESMC_ORIGIN_COMMS		2
+/* Origin of the return value when set by the Trusted OS itself */
+#define TEESMC_ORIGIN_TEE		3
+
+/* Return values in ret, same as the GlobalPlatform TEEC_ERROR_* */
+#define TEESMC_ERROR_CANCEL		0xFFFF0002
+#define TEESMC_ERROR_BAD_PARAMETERS	0xFFFF0006
+#define TEESMC_ERROR_ITEM_NOT_FOUND	0xFFFF0008
+#define TEESMC_ERROR_NOT_SUPPORTED	0xFFFF000A
+#define TEESMC_ERROR_OUT_OF_MEMORY	0xFFFF000C
+
 /**
  * struct teesmc32_param_memref - memory reference
  * @buf_ptr: Address of the buffer
@@ -243,6 +275,84 @@ struct teesmc32_arg {
 	 sizeof(union teesmc32_param) * (num_params) + \
 	 sizeof(uint8_t) * (num_params))
 
+/*
+ * Maximum number of parameters embedded in a struct teesmc32_arg, a
+ * struct teesmc32_arg with more is rejected with TEESMC_RETURN_EBADCMD.
+ */
+#define TEESMC32_MAX_NUM_PARAMS		8
+
+/**
+ * struct teesmc32_ring - header of the shared memory command rings
+ * @sq_tail: Index of next free submission entry, written by normal world
+ * @sq_head: Index of next submission to consume, written by secure world
+ * @cq_tail: Index of next free completion entry, written by secure world
+ * @cq_head: Index of next completion to consume, written by normal world
+ * @draining: Non-zero while secure world drains the submission ring,
+ *	      written by secure world
+ *
+ * The header is followed by num_entries struct teesmc32_ring_sqe and
+ * num_entries struct teesmc32_ring_cqe, num_entries being the value
+ * supplied with TEESMC32_FASTCALL_REGISTER_RING. The indices are free
+ * running, the entry of an index is found with index & (num_entries - 1).
+ *
+ * Normal world fills in a submission entry before it updates sq_tail.
+ * Secure world writes a completion entry before it updates cq_tail. A
+ * submission is only consumed if there's room for its completion.
+ *
+ * After updating sq_tail, or cq_head of a full completion ring, normal
+ * world issues a memory barrier and reads draining. If it's zero,
+ * normal world rings the doorbell. Secure world clears draining, issues
+ * a memory barrier and checks the rings again before it stops
+ * draining, so either side sees the update of the other.
+ */
+struct teesmc32_ring {
+	uint32_t sq_tail;
+	uint32_t sq_head;
+	uint32_t cq_tail;
+	uint32_t cq_head;
+	uint32_t draining;
+#if 0
+	struct teesmc32_ring_sqe sq[num_entries];
+	struct teesmc32_ring_cqe cq[num_entries];
+#endif
+};
+
+/**
+ * struct teesmc32_ring_sqe - submission ring entry
+ * @arg: Physical pointer to a struct teesmc32_arg
+ * @cookie: Opaque value returned in the completion entry
+ */
+struct teesmc32_ring_sqe {
+	uint32_t arg;
+	uint32_t cookie;
+};
+
+/**
+ * struct teesmc32_ring_cqe - completion ring entry
+ * @cookie: Cookie of the submission entry
+ * @ret: TEESMC_RETURN_OK if the struct teesmc32_arg was processed and
+ *	 updated, TEESMC_RETURN_EBADCMD if @arg isn't mapped, else
+ *	 TEESMC_RETURN_UNKNOWN_FUNCTION
+ */
+struct teesmc32_ring_cqe {
+	uint32_t cookie;
+	uint32_t ret;
+};
+
+#define TEESMC32_RING_GET_SQ(x) \
+	(struct teesmc32_ring_sqe *)(((struct teesmc32_ring *)(x)) + 1)
+
+#define TEESMC32_RING_GET_CQ(x, num_entries) \
+	(struct teesmc32_ring_cqe *)(TEESMC32_RING_GET_SQ(x) + (num_entries))
+
+#define TEESMC32_RING_GET_SIZE(num_entries) \
+	(sizeof(struct teesmc32_ring) + \
+	 sizeof(struct teesmc32_ring_sqe) * (num_entries) + \
+	 sizeof(struct teesmc32_ring_cqe) * (num_entries))
+
+/* Maximum number of entries in each ring */
+#define TEESMC32_RING_MAX_ENTRIES	4096
+
 /**
  * struct teesmc64_arg - SMC argument for Trusted OS
  * @cmd: OS Command, one of TEESMC_CMD_*
@@ -378,9 +488,11 @@ struct teesmc_meta_open_session {
 /*
  * Function specified by SMC Calling convention.
  *
- * Returns 4 if using API specified in this file without further extentions.
+ * Returns 12 if using API specified in this file without further
+ * extentions, one for each of TEESMC_FUNCID_GET_OS_UUID up to
+ * TEESMC_FUNCID_PRINT_STATS. Has to be updated when a function is added.
  */
-#define TEESMC_CALLS			4
+#define TEESMC_CALLS			12
 #define TEESMC32_FUNCID_CALLS_COUNT	0xFF00
 #define TEESMC32_CALLS_COUNT \
 	TEESMC_CALL_VAL(TEESMC_32, TEESMC_FAST_CALL, \
@@ -458,7 +570,8 @@ struct teesmc_meta_open_session {
  *
  * Normal return register usage:
  * r0/x0	Return value, TEESMC_RETURN_*
- * r1-3/x1-3	Not used
+ * r1/x1	Wait ticket to wake, 0 if none, see TEESMC_RETURN_EWAIT
+ * r2-3/x2-3	Not used
  * r4-7/x4-7	Preserved
  *
  * Ebusy return register usage:
@@ -466,6 +579,12 @@ struct teesmc_meta_open_session {
  * r1-3/x1-3	Preserved
  * r4-7/x4-7	Preserved
  *
+ * Ewait return register usage:
+ * r0/x0	Return value, TEESMC_RETURN_EWAIT
+ * r1/x1	Wait ticket
+ * r2-3/x2-3	Not used
+ * r4-7/x4-7	Preserved
+ *
  * RPC return register usage:
  * r0/x0	Return value, TEESMC_RETURN_IS_RPC(val)
  * r1-2/x1-2	RPC parameters
@@ -478,6 +597,21 @@ struct teesmc_meta_open_session {
  *					the previously supplied struct
  *					teesmc32_arg.
  * TEESMC_RETURN_EBUSY			Trusted OS busy, try again later.
+ * TEESMC_RETURN_EWAIT			No thread available, the call is
+ *					queued with the returned wait ticket.
+ *					Normal world should reissue the call
+ *					once a normal return has supplied a
+ *					wait ticket equal to or later than
+ *					this one. Tickets are increasing and
+ *					are compared with serial number
+ *					arithmetic. The queue only paces
+ *					the retries, there's no FIFO
+ *					guarantee. A reissued call gets no
+ *					priority and the freed thread may go
+ *					to another call, the reissued call
+ *					then gets a new, later ticket. A
+ *					wait ticket may also release several
+ *					waiters with earlier tickets.
  * TEESMC_RETURN_IS_RPC()		Call suspended by RPC call to normal
  *					world.
  */
@@ -485,7 +619,14 @@ struct teesmc_meta_open_session {
 #define TEESMC32_CALL_WITH_ARG \
 	TEESMC_CALL_VAL(TEESMC_32, TEESMC_STD_CALL, TEESMC_OWNER_TRUSTED_OS, \
 	TEESMC_FUNCID_CALL_WITH_ARG)
-/* Same as TEESMC32_CALL_WITH_ARG but a "fast call". */
+/*
+ * Same as TEESMC32_CALL_WITH_ARG but a "fast call", completed without
+ * allocating a thread. Only TEESMC_CMD_CANCEL and
+ * TEESMC_CMD_INVOKE_COMMAND of TA functions registered as non-blocking
+ * and with value parameters only are supported, other commands get ret
+ * TEESMC_ERROR_NOT_SUPPORTED and should be issued with
+ * TEESMC32_CALL_WITH_ARG instead.
+ */
 #define TEESMC32_FASTCALL_WITH_ARG \
 	TEESMC_CALL_VAL(TEESMC_32, TEESMC_FAST_CALL, TEESMC_OWNER_TRUSTED_OS, \
 	TEESMC_FUNCID_CALL_WITH_ARG)
@@ -551,6 +692,225 @@ struct teesmc_meta_open_session {
 	TEESMC_CALL_VAL(TEESMC_64, TEESMC_STD_CALL, TEESMC_OWNER_TRUSTED_OS, \
 			TEESMC_FUNCID_RETURN_FROM_RPC)
 
+/*
+ * Call with a batch of struct teesmc32_arg as argument
+ *
+ * The entries are stored back to back in one physically contiguous
+ * buffer, each entry starting at the offset given by
+ * TEESMC32_GET_BATCH_ARG_SIZE() of the preceding entries. The entries
+ * are processed in order on one thread and the result of each is
+ * written to ret and ret_origin of the entry.
+ *
+ * Call register usage:
+ * r0/x0	SMC Function ID, TEESMC32_CALL_WITH_ARG_BATCH
+ * r1/x1	Physical pointer to the first struct teesmc32_arg
+ * r2/x2	Number of entries in the batch
+ * r3/x3	Size in bytes of the buffer holding the entries
+ * r4-6/x4-6	Not used
+ * r7/x7	Hypervisor Client ID register
+ *
+ * Return register usage is the same as for TEESMC32_CALL_WITH_ARG above.
+ *
+ * Possible return values are the same as for TEESMC32_CALL_WITH_ARG
+ * above, and:
+ * TEESMC_RETURN_EBADCMD		An entry doesn't fit inside the
+ *					buffer or has more than
+ *					TEESMC32_MAX_NUM_PARAMS parameters,
+ *					entries before it are processed and
+ *					updated.
+ */
+#define TEESMC_FUNCID_CALL_WITH_ARG_BATCH	5
+#define TEESMC32_CALL_WITH_ARG_BATCH \
+	TEESMC_CALL_VAL(TEESMC_32, TEESMC_STD_CALL, TEESMC_OWNER_TRUSTED_OS, \
+			TEESMC_FUNCID_CALL_WITH_ARG_BATCH)
+
+/**
+ * TEESMC32_GET_BATCH_ARG_SIZE - return size of an entry in a batch
+ *
+ * @num_params: Number of parameters embedded in the struct teesmc32_arg
+ *
+ * Returns TEESMC32_GET_ARG_SIZE() rounded up to keep the next entry
+ * 32-bit aligned.
+ */
+#define TEESMC32_GET_BATCH_ARG_SIZE(num_params) \
+	((TEESMC32_GET_ARG_SIZE(num_params) + 3) & ~3)
+
+/*
+ * Register the shared memory command rings, see struct teesmc32_ring
+ *
+ * Normal world must clear the header before registering. A ring can
+ * only be replaced while no TEESMC32_CALL_RING_DOORBELL is in progress.
+ *
+ * Call register usage:
+ * r0/x0	SMC Function ID, TEESMC32_FASTCALL_REGISTER_RING
+ * r1/x1	Physical pointer to a struct teesmc32_ring
+ * r2/x2	Number of entries in each ring, a power of 2 not above
+ *		TEESMC32_RING_MAX_ENTRIES
+ * r3-7/x3-7	Not used
+ *
+ * Return register usage:
+ * r0/x0	Return value
+ * r1-3/x1-3	Not used
+ *
+ * Possible return values:
+ * TEESMC_RETURN_OK			Rings registered
+ * TEESMC_RETURN_EBUSY			Rings are in use, try again later
+ * TEESMC_RETURN_EBADCMD		Bad address or number of entries, or
+ *					the rings aren't in non-secure
+ *					memory
+ */
+#define TEESMC_FUNCID_REGISTER_RING	6
+#define TEESMC32_FASTCALL_REGISTER_RING \
+	TEESMC_CALL_VAL(TEESMC_32, TEESMC_FAST_CALL, TEESMC_OWNER_TRUSTED_OS, \
+			TEESMC_FUNCID_REGISTER_RING)
+
+/*
+ * Drain the submission ring
+ *
+ * Processes submissions until the submission ring is empty or the
+ * completion ring is full. Submissions added while draining are
+ * processed by the same call, so it's enough to ring the doorbell when
+ * draining of struct teesmc32_ring is zero. Several calls may drain
+ * the ring concurrently on different threads, completions are then not
+ * necessarily in submission order.
+ *
+ * Call register usage:
+ * r0/x0	SMC Function ID, TEESMC32_CALL_RING_DOORBELL
+ * r1-6/x1-6	Not used
+ * r7/x7	Hypervisor Client ID register
+ *
+ * Return register usage is the same as for TEESMC32_CALL_WITH_ARG above.
+ *
+ * Possible return values are the same as for TEESMC32_CALL_WITH_ARG
+ * above, and:
+ * TEESMC_RETURN_EBADCMD		No ring is registered
+ */
+#define TEESMC_FUNCID_RING_DOORBELL	7
+#define TEESMC32_CALL_RING_DOORBELL \
+	TEESMC_CALL_VAL(TEESMC_32, TEESMC_STD_CALL, TEESMC_OWNER_TRUSTED_OS, \
+			TEESMC_FUNCID_RING_DOORBELL)
+
+/*
+ * Donate non-secure memory for RPC argument and payload buffers
+ *
+ * Trusted OS sub-allocates RPC memory from the region and only uses
+ * TEESMC_RETURN_RPC_ALLOC and TEESMC_RETURN_RPC_FREE when it's
+ * exhausted. The region stays in use until normal world is restarted
+ * and can only be registered once.
+ *
+ * Call register usage:
+ * r0/x0	SMC Function ID, TEESMC32_FASTCALL_REGISTER_RPC_POOL
+ * r1/x1	Physical pointer to the region, 64 bytes aligned
+ * r2/x2	Size in bytes of the region
+ * r3-7/x3-7	Not used
+ *
+ * Return register usage:
+ * r0/x0	Return value
+ * r1-3/x1-3	Not used
+ *
+ * Possible return values:
+ * TEESMC_RETURN_OK			Region registered
+ * TEESMC_RETURN_EBADCMD		Bad region or already registered
+ */
+#define TEESMC_FUNCID_REGISTER_RPC_POOL	8
+#define TEESMC32_FASTCALL_REGISTER_RPC_POOL \
+	TEESMC_CALL_VAL(TEESMC_32, TEESMC_FAST_CALL, TEESMC_OWNER_TRUSTED_OS, \
+			TEESMC_FUNCID_REGISTER_RPC_POOL)
+
+/*
+ * Register non-secure shared memory
+ *
+ * Memory referred to by struct teesmc32_param_memref has to be inside a
+ * registered range and the TEESMC_ATTR_CACHE_* bits of the parameter
+ * must match those of the range. Ranges sharing a 1 MiB section must
+ * use the same cache attributes. A range is at most
+ * TEESMC_SHM_MAX_SIZE bytes, as its cache is cleaned by the fastcall.
+ *
+ * Call register usage:
+ * r0/x0	SMC Function ID, TEESMC32_FASTCALL_REGISTER_SHM
+ * r1/x1	Physical address of the range
+ * r2/x2	Size in bytes of the range
+ * r3/x3	Cache attributes, TEESMC_ATTR_CACHE_* not shifted
+ * r4-7/x4-7	Not used
+ *
+ * Return register usage:
+ * r0/x0	Return value
+ * r1-3/x1-3	Not used
+ *
+ * Possible return values:
+ * TEESMC_RETURN_OK			Range registered
+ * TEESMC_RETURN_EBUSY			Try again later
+ * TEESMC_RETURN_EBADCMD		Bad or overlapping range, too many
+ *					ranges or conflicting cache
+ *					attributes
+ */
+#define TEESMC_SHM_MAX_SIZE		0x400000
+#define TEESMC_FUNCID_REGISTER_SHM	9
+#define TEESMC32_FASTCALL_REGISTER_SHM \
+	TEESMC_CALL_VAL(TEESMC_32, TEESMC_FAST_CALL, TEESMC_OWNER_TRUSTED_OS, \
+			TEESMC_FUNCID_REGISTER_SHM)
+
+/*
+ * Unregister non-secure shared memory
+ *
+ * Call register usage:
+ * r0/x0	SMC Function ID, TEESMC32_FASTCALL_UNREGISTER_SHM
+ * r1/x1	Physical address of the range as when registered
+ * r2-7/x2-7	Not used
+ *
+ * Return register usage:
+ * r0/x0	Return value
+ * r1-3/x1-3	Not used
+ *
+ * Possible return values:
+ * TEESMC_RETURN_OK			Range unregistered
+ * TEESMC_RETURN_EBUSY			Range in use, try again later
+ * TEESMC_RETURN_EBADCMD		No range registered at the address
+ */
+#define TEESMC_FUNCID_UNREGISTER_SHM	10
+#define TEESMC32_FASTCALL_UNREGISTER_SHM \
+	TEESMC_CALL_VAL(TEESMC_32, TEESMC_FAST_CALL, TEESMC_OWNER_TRUSTED_OS, \
+			TEESMC_FUNCID_UNREGISTER_SHM)
+
+/*
+ * Print the maximum usage of each stack in secure world on the secure
+ * console. Stack usage is only tracked when Trusted OS is built with
+ * WITH_STACK_CANARIES.
+ *
+ * Call register usage:
+ * r0/x0	SMC Function ID, TEESMC32_FASTCALL_PRINT_STACK_USAGE
+ * r1-7/x1-7	Not used
+ *
+ * Return register usage:
+ * r0/x0	TEESMC_RETURN_OK
+ * r1-3/x1-3	Not used
+ */
+#define TEESMC_FUNCID_PRINT_STACK_USAGE	4
+#define TEESMC32_FASTCALL_PRINT_STACK_USAGE \
+	TEESMC_CALL_VAL(TEESMC_32, TEESMC_FAST_CALL, TEESMC_OWNER_TRUSTED_OS, \
+			TEESMC_FUNCID_PRINT_STACK_USAGE)
+
+/*
+ * Print the cycle statistics of the completed stdcalls on the secure
+ * console, per TEESMC_CMD_* command and per hypervisor client ID,
+ * together with the RPC suspend and resume cycles and the FIQ latency
+ * of the CPU doing the call. Statistics
+ * are only collected when Trusted OS is built with
+ * WITH_THREAD_CYCLE_STATS.
+ *
+ * Call register usage:
+ * r0/x0	SMC Function ID, TEESMC32_FASTCALL_PRINT_STATS
+ * r1-7/x1-7	Not used
+ *
+ * Return register usage:
+ * r0/x0	TEESMC_RETURN_OK
+ * r1-3/x1-3	Not used
+ */
+#define TEESMC_FUNCID_PRINT_STATS	11
+#define TEESMC32_FASTCALL_PRINT_STATS \
+	TEESMC_CALL_VAL(TEESMC_32, TEESMC_FAST_CALL, TEESMC_OWNER_TRUSTED_OS, \
+			TEESMC_FUNCID_PRINT_STATS)
+
 /*
  * From secure monitor to Trusted OS, handle FIQ
  *
@@ -626,7 +986,9 @@ struct teesmc_meta_open_session {
 #define TEESMC_RETURN_RPC_FREE		TEESMC_RPC_VAL(TEESMC_RPC_FUNC_FREE)
 
 /*
- * Deliver an IRQ in normal world.
+ * Deliver an IRQ in normal world. Also used when the time slice of the
+ * thread has expired to give normal world a chance to run other work
+ * before resuming the thread.
  *
  * "Call" register usage:
  * r0/x0	TEESMC_RETURN_RPC_IRQ
@@ -668,6 +1030,33 @@ struct teesmc_meta_open_session {
 #define TEESMC_RPC_FUNC_CMD		3
 #define TEESMC_RETURN_RPC_CMD		TEESMC_RPC_VAL(TEESMC_RPC_FUNC_CMD)
 
+/*
+ * Do an RPC request carried in registers. Same as TEESMC_RETURN_RPC_CMD
+ * but for requests with at most two value parameters, saving the
+ * TEESMC_RETURN_RPC_ALLOC and TEESMC_RETURN_RPC_FREE round trips needed
+ * to supply a struct teesmc32_arg.
+ *
+ * "Call" register usage:
+ * r0		TEESMC_RETURN_RPC_CMD_REGS
+ * r1		The Request ID
+ * r2		Value a of the first parameter
+ * r3		Resume information, must be preserved
+ * r4		Value b of the first parameter
+ * r5		Value a of the second parameter
+ * r6		Value b of the second parameter
+ * r7		Resume information, must be preserved
+ *
+ * "Return" register usage:
+ * r0		SMC Function ID, TEESMC32_CALL_RETURN_FROM_RPC
+ * r1		Return value of the request
+ * r2		Updated value a of the first parameter
+ * r3		Preserved
+ * r4-6		Updated values as in the "Call" above
+ * r7		Preserved
+ */
+#define TEESMC_RPC_FUNC_CMD_REGS	4
+#define TEESMC_RETURN_RPC_CMD_REGS	TEESMC_RPC_VAL(TEESMC_RPC_FUNC_CMD_REGS)
+
 
 /* Returned in r0 */
 #define TEESMC_RETURN_UNKNOWN_FUNCTION	0xFFFFFFFF
@@ -676,6 +1065,8 @@ struct teesmc_meta_open_session {
 #define TEESMC_RETURN_OK		0x0
 #define TEESMC_RETURN_EBUSY		0x1
 #define TEESMC_RETURN_ERESUME		0x2
+#define TEESMC_RETURN_EWAIT		0x3
+#define TEESMC_RETURN_EBADCMD		0x4
 #define TEESMC_RETURN_IS_RPC(ret) \
 	(((ret) & TEESMC_RETURN_RPC_PREFIX_MASK) == TEESMC_RETURN_RPC_PREFIX)
 
@@ -31,5 +31,8 @@
 
 void tee_entry(struct thread_smc_args *args);
 
+/* Called once during boot before normal world is started */
+void tee_entry_init(void);
+
 #endif /*TEE_ENTRY_H*/
 
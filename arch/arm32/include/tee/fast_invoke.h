@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2014, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef TEE_FAST_INVOKE_H
+#define TEE_FAST_INVOKE_H
+
+#include <stdint.h>
+#include <sm/teesmc.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define TEE_FAST_INVOKE_MAX_FUNCS	16
+
+/*
+ * A fast invoke function runs to completion on the temporary stack of
+ * the core with IRQ and FIQ masked, there's no thread to suspend. It
+ * must not do RPCs, wait for a mutex or run for long. Only value
+ * parameters are passed, num_params is the number of parameters checked
+ * by the caller as arg32 is in normal world memory and may change at
+ * any time. Returns the TEEC_ERROR_* style result stored in ret of the
+ * struct teesmc32_arg.
+ */
+typedef uint32_t (*tee_fast_invoke_func_t)(void *sess_ctx,
+					  struct teesmc32_arg *arg32,
+					  size_t num_params);
+
+/*
+ * Registers a function to be called for TEESMC_CMD_INVOKE_COMMAND with
+ * ta_func when it's issued with TEESMC32_FASTCALL_WITH_ARG. Must be
+ * called during boot before normal world is started since the table is
+ * read without locking. Returns false if the table is full or ta_func
+ * is already registered.
+ */
+bool tee_fast_invoke_register(uint32_t ta_func, tee_fast_invoke_func_t func);
+
+/* Returns the function registered for ta_func or NULL */
+tee_fast_invoke_func_t tee_fast_invoke_find(uint32_t ta_func);
+
+#endif /*TEE_FAST_INVOKE_H*/
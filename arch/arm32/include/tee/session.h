@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2014, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef TEE_SESSION_H
+#define TEE_SESSION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * A session handle holds the index of the session in the session table
+ * in the lower bits and a generation count in the upper bits, a stale
+ * handle of a closed session is never resolved to a new session. 0 is
+ * never a valid handle.
+ */
+#define TEE_SESSION_IDX_BITS	16
+#define TEE_SESSION_IDX_MASK	((1 << TEE_SESSION_IDX_BITS) - 1)
+
+struct tee_session {
+	uint32_t handle;	/* 0 when closed */
+	uint32_t generation;
+	uint32_t refcount;	/* Updated with atomic_cas32() */
+	uint32_t next_free;
+	void *ctx;		/* Per session context of the TA */
+};
+
+/* Initializes the session table, called once at boot */
+void tee_session_init(void);
+
+/*
+ * Allocates a session and returns it with a reference held by the
+ * session table, NULL if the table is full.
+ */
+struct tee_session *tee_session_open(void);
+
+/*
+ * Removes the handle from the table and drops the reference held by the
+ * table, the session is freed when the last reference is dropped.
+ * Returns false if the handle is invalid.
+ */
+bool tee_session_close(uint32_t handle);
+
+/*
+ * Resolves a handle to its session and takes a reference, NULL if the
+ * handle is invalid or the session is closed.
+ */
+struct tee_session *tee_session_get(uint32_t handle);
+
+/* Drops a reference taken with tee_session_get() */
+void tee_session_put(struct tee_session *s);
+
+#endif /*TEE_SESSION_H*/
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2014, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef TEE_SHM_H
+#define TEE_SHM_H
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Maximum number of registered shared memory ranges */
+#define TEE_SHM_MAX_RANGES	32
+
+/*
+ * Registers the non-secure range [pa, pa + size) as shared memory, it's
+ * mapped with the cache policy of cache_attr, TEESMC_ATTR_CACHE_*.
+ * Called from a fastcall. Returns a TEESMC_RETURN_* value.
+ */
+uint32_t tee_shm_register(paddr_t pa, size_t size, uint32_t cache_attr);
+
+/*
+ * Unregisters the range starting at pa, fails with TEESMC_RETURN_EBUSY
+ * while the range is in use. Returns a TEESMC_RETURN_* value.
+ */
+uint32_t tee_shm_unregister(paddr_t pa);
+
+/*
+ * Returns the virtual address of [pa, pa + size) if it's inside a
+ * registered range with matching cache_attr, 0 otherwise. The range
+ * can't be unregistered until tee_shm_put() is called.
+ */
+vaddr_t tee_shm_get(paddr_t pa, size_t size, uint32_t cache_attr);
+
+/* Releases a range previously returned by tee_shm_get() */
+void tee_shm_put(paddr_t pa);
+
+#endif /*TEE_SHM_H*/
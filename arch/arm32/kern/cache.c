@@ -25,6 +25,7 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 #include <arm32.h>
+#include <plat.h>
 #include <kern/cache.h>
 
 void cache_tlb_invalidate(void)
@@ -33,3 +34,35 @@ void cache_tlb_invalidate(void)
 	dsb();
 	isb();
 }
+
+/* More entries than this are cheaper to invalidate all at once */
+#define CACHE_TLB_INV_MAX_ENTRIES	64
+
+void cache_tlb_invalidate_range(vaddr_t va, size_t len, size_t stride)
+{
+	vaddr_t end = va + len;
+	vaddr_t a;
+
+	if (len / stride > CACHE_TLB_INV_MAX_ENTRIES) {
+		dsb();
+		cache_tlb_invalidate();
+		return;
+	}
+
+	/* Make table updates visible to the table walk before invalidating */
+	dsb();
+	for (a = va & ~(stride - 1); a < end; a += stride)
+		write_tlbimvaais(a);
+	dsb();
+	isb();
+}
+
+void cache_dcache_clean_inv_range(vaddr_t va, size_t len)
+{
+	vaddr_t a;
+
+	for (a = va & ~(CACHE_LINE_SIZE - 1); a < va + len;
+			a += CACHE_LINE_SIZE)
+		write_dccimvac(a);
+	dsb();
+}
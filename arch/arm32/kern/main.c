@@ -32,38 +32,45 @@
 #include <drivers/gic.h>
 #include <drivers/uart.h>
 #include <kprintf.h>
+#include <trace.h>
 #include <sm/sm.h>
 #include <sm/sm_defs.h>
 
 #include <kern/mmu.h>
+#include <kern/cache.h>
 #include <kern/kern.h>
+#include <kern/misc.h>
 #include <kern/resmem.h>
 #include <kern/arch_debug.h>
 
 #include <arm32.h>
 #include <kern/thread.h>
+#include <kern/thread_defs.h>
 #include <kern/panic.h>
 
+#include <sm/teesmc.h>
 #include <tee/entry.h>
 
 #include <assert.h>
 
 #ifdef WITH_STACK_CANARIES
-#define STACK_CANARY_SIZE	(4 * sizeof(uint32_t))
-#define START_CANARY_VALUE	0xdededede
-#define END_CANARY_VALUE	0xabababab
-#define GET_START_CANARY(name, stack_num) name[stack_num][0]
+#define GET_START_CANARY(name, stack_num) \
+	name[stack_num][STACK_GUARD_SIZE / sizeof(uint32_t)]
 #define GET_END_CANARY(name, stack_num) \
 	name[stack_num][sizeof(name[stack_num]) / sizeof(uint32_t) - 1]
+#endif
+
+#ifdef WITH_STACK_GUARD_PAGES
+#define STACK_SLOT_ALIGNMENT	STACK_GUARD_SIZE
 #else
-#define STACK_CANARY_SIZE	0
+#define STACK_SLOT_ALIGNMENT	STACK_ALIGMENT
 #endif
 
 #define DECLARE_STACK(name, num_stacks, stack_size) \
-	static uint32_t name[num_stacks][(stack_size + STACK_CANARY_SIZE) / \
+	static uint32_t name[num_stacks][STACK_SLOT_SIZE(stack_size) / \
 					 sizeof(uint32_t)] \
 		__attribute__((section(".bss.prebss.stack"), \
-			       aligned(STACK_ALIGMENT)))
+			       aligned(STACK_SLOT_ALIGNMENT)))
 
 #define GET_STACK(stack) \
 	((vaddr_t)(stack) + sizeof(stack) - STACK_CANARY_SIZE / 2)
@@ -72,7 +79,6 @@
 DECLARE_STACK(stack_tmp,	NUM_CPUS,	STACK_TMP_SIZE);
 DECLARE_STACK(stack_abt,	NUM_CPUS,	STACK_ABT_SIZE);
 DECLARE_STACK(stack_sm,		NUM_CPUS,	SM_STACK_SIZE);
-DECLARE_STACK(stack_thread,	NUM_THREADS,	STACK_THREAD_SIZE);
 
 const vaddr_t stack_tmp_top[NUM_CPUS] = {
 	GET_STACK(stack_tmp[0]),
@@ -92,6 +98,13 @@ const vaddr_t stack_tmp_top[NUM_CPUS] = {
 
 static bool inited;
 
+/*
+ * Set once main_init() is done, secondary CPUs spin on it with the MMU
+ * and caches off in reset. Kept out of BSS as it's read before BSS is
+ * cleared.
+ */
+uint32_t main_secondary_release __attribute__((section(".data")));
+
 uint32_t mmu_l1_table[MMU_L1_NUM_ENTRIES]
 	__attribute__((section(".bss.prebss.mmu"), aligned(MMU_L1_ALIGNMENT)));
 
@@ -122,16 +135,119 @@ static void init_canaries(void)
 									\
 		*start_canary = START_CANARY_VALUE;			\
 		*end_canary = END_CANARY_VALUE;				\
-		kprintf("#Stack canaries for %s[%zu] with top at %p\n", \
+		stack_paint(start_canary + 1, end_canary);		\
+		DMSG("#Stack canaries for %s[%zu] with top at %p\n",	\
 			#name, n, (void *)(end_canary - 1));		\
-		kprintf("#watch inited && *%p\n", (void *)start_canary);\
-		kprintf("watch inited && *%p\n", (void *)end_canary);	\
+		DMSG("#watch inited && *%p\n", (void *)start_canary);	\
+		DMSG("watch inited && *%p\n", (void *)end_canary);	\
 	}
 
 	INIT_CANARY(stack_tmp);
 	INIT_CANARY(stack_abt);
 	INIT_CANARY(stack_sm);
-	INIT_CANARY(stack_thread);
+}
+
+#ifdef WITH_STACK_CANARIES
+void stack_paint(uint32_t *start, uint32_t *end)
+{
+	uint32_t *sp = (uint32_t *)read_sp();
+	uint32_t *p;
+
+	/* Don't overwrite anything on the stack we're running on */
+	if (sp >= start && sp < end)
+		end = sp;
+
+	for (p = start; p < end; p++)
+		*p = STACK_PAINT_VALUE;
+}
+
+size_t stack_max_usage(const uint32_t *start, const uint32_t *end)
+{
+	const uint32_t *p = start;
+
+	while (p < end && *p == STACK_PAINT_VALUE)
+		p++;
+
+	return (end - p) * sizeof(uint32_t);
+}
+#endif /*WITH_STACK_CANARIES*/
+
+void print_stack_usage(void)
+{
+#ifdef WITH_STACK_CANARIES
+	size_t n;
+
+#define PRINT_STACK_USAGE(name)						\
+	for (n = 0; n < ARRAY_SIZE(name); n++) {			\
+		kprintf("Stack %s[%zu]: max %zu of %zu bytes used\n",	\
+			#name, n,					\
+			stack_max_usage(&GET_START_CANARY(name, n) + 1,	\
+					&GET_END_CANARY(name, n)),	\
+			sizeof(name[n]) - STACK_CANARY_SIZE -		\
+				STACK_GUARD_SIZE);			\
+	}
+
+	PRINT_STACK_USAGE(stack_tmp);
+	PRINT_STACK_USAGE(stack_abt);
+	PRINT_STACK_USAGE(stack_sm);
+	thread_print_stack_usage();
+#endif /*WITH_STACK_CANARIES*/
+}
+
+static void print_cycle_stats(const char *name, uint32_t idx,
+		const struct thread_cycle_stats *s)
+{
+	if (!s->num_calls)
+		return;
+	kprintf("Cycles %s[%u]: %llu in %u calls, %llu per call\n", name,
+		idx, s->cycles, s->num_calls, s->cycles / s->num_calls);
+}
+
+void print_stats(void)
+{
+	struct thread_fiq_latency_stats fiq;
+	struct thread_cycle_stats s;
+	struct thread_cycle_stats r;
+	uint32_t n;
+
+	if (thread_get_rpc_switch_stats(&s, &r)) {
+		print_cycle_stats("rpc suspend", get_core_pos(), &s);
+		print_cycle_stats("rpc resume", get_core_pos(), &r);
+	}
+
+	if (thread_get_fiq_latency_stats(&fiq) && fiq.num_fiqs)
+		kprintf("FIQ latency CPU %zu: avg %llu min %u max %u in %u\n",
+			get_core_pos(), fiq.cycles / fiq.num_fiqs,
+			fiq.min_cycles, fiq.max_cycles, fiq.num_fiqs);
+
+	for (n = 0; n < THREAD_STATS_NUM_CMDS; n++) {
+		if (!thread_get_cmd_cycle_stats(n, &s))
+			return;
+		print_cycle_stats("cmd", n, &s);
+	}
+	/* The last client entry also counts the IDs above it */
+	for (n = 0; n < THREAD_STATS_NUM_CLNTS; n++) {
+		if (!thread_get_clnt_cycle_stats(n, &s))
+			return;
+		print_cycle_stats("clnt", n, &s);
+	}
+}
+
+static void init_guard_pages(void)
+{
+#ifdef WITH_STACK_GUARD_PAGES
+	size_t n;
+
+#define INIT_GUARD_PAGE(name)						\
+	for (n = 0; n < ARRAY_SIZE(name); n++) {			\
+		if (!mmu_map_guard_page((vaddr_t)name[n]))		\
+			panic();					\
+	}
+
+	INIT_GUARD_PAGE(stack_tmp);
+	INIT_GUARD_PAGE(stack_abt);
+	INIT_GUARD_PAGE(stack_sm);
+#endif /*WITH_STACK_GUARD_PAGES*/
 }
 
 void check_canaries(void)
@@ -148,8 +264,8 @@ void check_canaries(void)
 	ASSERT_STACK_CANARIES(stack_tmp);
 	ASSERT_STACK_CANARIES(stack_abt);
 	ASSERT_STACK_CANARIES(stack_sm);
-	ASSERT_STACK_CANARIES(stack_thread);
 #endif /*WITH_STACK_CANARIES*/
+	thread_check_canaries();
 }
 
 static const struct thread_handlers handlers = {
@@ -171,7 +287,6 @@ void main_init(uint32_t nsec_entry)
 	uintptr_t begin_resmem = (uintptr_t)&_end;
 	uintptr_t end_resmem = (uintptr_t)&_end_of_ram;
 	struct sm_nsec_ctx *nsec_ctx;
-	size_t n;
 
 	resmem_init(begin_resmem, end_resmem);
 
@@ -181,7 +296,7 @@ void main_init(uint32_t nsec_entry)
 	kprintf_init((kvprintf_putc)uart_putc,
 		(kprintf_flush_output)uart_flush_tx_fifo, (void *)UART1_BASE);
 
-	kprintf("Trusted OS initializing\n");
+	IMSG("Trusted OS initializing\n");
 
 	mmu_init(mmu_l1_table, code_start, code_end, data_start, end_resmem);
 
@@ -205,15 +320,15 @@ void main_init(uint32_t nsec_entry)
 
 	/* Initialize canries around the stacks */
 	init_canaries();
+	init_guard_pages();
 
 	if (!thread_init_stack(THREAD_TMP_STACK, GET_STACK(stack_tmp[0])))
 		panic();
 	if (!thread_init_stack(THREAD_ABT_STACK, GET_STACK(stack_abt[0])))
 		panic();
-	for (n = 0; n < NUM_THREADS; n++) {
-		if (!thread_init_stack(n, GET_STACK(stack_thread[n])))
-			panic();
-	}
+	/* Thread stacks are allocated from reserved memory */
+	if (!thread_init_pool(STACK_THREAD_SIZE, NUM_THREADS))
+		panic();
 	/*
 	 * Mask IRQ and FIQ before switch to the thread vector as the
 	 * thread handler requires IRQ and FIQ to be masked while executing
@@ -221,6 +336,7 @@ void main_init(uint32_t nsec_entry)
 	 */
 	write_cpsr(read_cpsr() | CPSR_F | CPSR_I);
 	thread_init_handlers(&handlers);
+	tee_entry_init();
 
 	/* Initialize secure monitor */
 	sm_init(GET_STACK(stack_sm[0]));
@@ -236,46 +352,130 @@ void main_init(uint32_t nsec_entry)
 	gic_it_set_prio(IT_UART1, 0xff);
 	gic_it_enable(IT_UART1);
 
+#if THREAD_SCHED_POLICY == THREAD_SCHED_TIME_SLICED
+	/* Secure physical timer drives the time slices of the threads */
+	gic_it_add(IT_SEC_PHY_TIMER);
+	gic_it_set_prio(IT_SEC_PHY_TIMER, 0xff);
+	gic_it_enable(IT_SEC_PHY_TIMER);
+#endif
+
 	inited = true;
-	kprintf("Switching to normal world boot\n");
+
+	main_secondary_release = 1;
+	cache_dcache_clean_inv_range((vaddr_t)&main_secondary_release,
+				     sizeof(main_secondary_release));
+	dsb();
+	sev();
+
+	IMSG("Switching to normal world boot\n");
+}
+
+void main_init_secondary(uint32_t nsec_entry); /* called from assembly only */
+void main_init_secondary(uint32_t nsec_entry)
+{
+	size_t pos = get_core_pos();
+	struct sm_nsec_ctx *nsec_ctx;
+
+	mmu_enable();
+
+	if (!thread_init_stack(THREAD_TMP_STACK, GET_STACK(stack_tmp[pos])))
+		panic();
+	if (!thread_init_stack(THREAD_ABT_STACK, GET_STACK(stack_abt[pos])))
+		panic();
+	write_cpsr(read_cpsr() | CPSR_F | CPSR_I);
+	thread_init_secondary();
+
+	sm_init(GET_STACK(stack_sm[pos]));
+	nsec_ctx = sm_get_nsec_ctx();
+	nsec_ctx->mon_lr = nsec_entry;
+	nsec_ctx->mon_spsr = CPSR_MODE_SVC | CPSR_I;
+
+	gic_cpu_init();
+#if THREAD_SCHED_POLICY == THREAD_SCHED_TIME_SLICED
+	/* The timer interrupt is private to each CPU */
+	gic_it_add(IT_SEC_PHY_TIMER);
+	gic_it_set_prio(IT_SEC_PHY_TIMER, 0xff);
+	gic_it_enable(IT_SEC_PHY_TIMER);
+#endif
+
+	IMSG("CPU %zu switching to normal world boot\n", pos);
 }
 
 static void main_stdcall(struct thread_smc_args *args)
 {
-	kprintf("%s\n", __func__);
+	FMSG("%s\n", __func__);
 	tee_entry(args);
 }
 
 static void main_fastcall(struct thread_smc_args *args)
 {
-	kprintf("%s\n", __func__);
-	tee_entry(args);
+	FMSG("%s\n", __func__);
+
+	switch (args->a0) {
+	case TEESMC32_CALLS_COUNT:
+		args->a0 = TEESMC_CALLS;
+		break;
+	case TEESMC32_CALLS_UID:
+		args->a0 = TEESMC_UID_R0;
+		args->a1 = TEESMC_UID_R1;
+		args->a2 = TEESMC_UID_R2;
+		args->a3 = TEESMC_UID_R3;
+		break;
+	case TEESMC32_CALLS_REVISION:
+		args->a0 = TEESMC_REVISION_MAJOR;
+		args->a1 = TEESMC_REVISION_MINOR;
+		break;
+	case TEESMC32_FASTCALL_PRINT_STACK_USAGE:
+		print_stack_usage();
+		args->a0 = TEESMC_RETURN_OK;
+		break;
+	case TEESMC32_FASTCALL_PRINT_STATS:
+		print_stats();
+		args->a0 = TEESMC_RETURN_OK;
+		break;
+	case TEESMC32_FASTCALL_REGISTER_RPC_POOL:
+		if (thread_rpc_pool_register(args->a1, args->a2))
+			args->a0 = TEESMC_RETURN_OK;
+		else
+			args->a0 = TEESMC_RETURN_EBADCMD;
+		break;
+	default:
+		tee_entry(args);
+		break;
+	}
 }
 
 static void main_fiq(void)
 {
 	uint32_t iar;
 
-	kprintf("%s\n", __func__);
+	FMSG("%s\n", __func__);
 
 	iar = gic_read_iar();
 
-	while (uart_have_rx_data(UART1_BASE))
-		kprintf("got 0x%x\n", uart_getchar(UART1_BASE));
+	if ((iar & GICC_IAR_IT_ID_MASK) == IT_SEC_PHY_TIMER) {
+		thread_sched_tick();
+	} else {
+		while (uart_have_rx_data(UART1_BASE)) {
+			int ch = uart_getchar(UART1_BASE);
+
+			DMSG("got 0x%x\n", ch);
+		}
+	}
 
 	gic_write_eoir(iar);
 
-	kprintf("return from %s\n", __func__);
+	FMSG("return from %s\n", __func__);
 }
 
 static void main_svc(struct thread_svc_regs *regs)
 {
-	kprintf("%s\n", __func__);
+	FMSG("%s\n", __func__);
 }
 
 static void main_abort(uint32_t abort_type,
 	struct thread_abort_regs *regs)
 {
-	kprintf("%s 0x%x\n", __func__, abort_type);
+	EMSG("%s 0x%x\n", __func__, abort_type);
 	panic();
 }
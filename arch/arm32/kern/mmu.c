@@ -31,6 +31,9 @@
 #include <arm32.h>
 #include <kern/mmu.h>
 #include <kern/cache.h>
+#include <kern/kern.h>
+#include <kern/mutex.h>
+#include <kern/percpu.h>
 
 
 #define MMU_L1_TYPE_WBWA \
@@ -39,6 +42,7 @@
 	((0x0 << MMU_L1_TEX_SHIFT) | MMU_L1_B)
 
 #define MMU_L1_TEX_SHIFT	12
+#define MMU_L1_TEX_CACHED	(0x4 << MMU_L1_TEX_SHIFT)
 
 #define MMU_L1_PAGE_TBL		0x1
 #define MMU_L1_SECTION		0x2
@@ -52,6 +56,23 @@
 #define MMU_L1_NG		(1 << 17)
 #define MMU_L1_NS		(1 << 19)
 
+#define MMU_L1_PT_NS		(1 << 3)
+
+#define MMU_L2_SMALL_PAGE	0x2
+#define MMU_L2_XN		(1 << 0)
+#define MMU_L2_B		(1 << 2)
+#define MMU_L2_C		(1 << 3)
+#define MMU_L2_AP0		(1 << 4)
+#define MMU_L2_AP1		(1 << 5)
+#define MMU_L2_TEX_SHIFT	6
+#define MMU_L2_AP2		(1 << 9)
+#define MMU_L2_S		(1 << 10)
+#define MMU_L2_NG		(1 << 11)
+
+#define MMU_L2_NUM_ENTRIES	256
+#define MMU_L2_ALIGNMENT	(1 << 10)	/* 1 KiB aligned */
+#define MMU_L2_TBL_MASK		(MMU_L2_ALIGNMENT - 1)
+
 #define MMU_SMALL_PAGE_SHIFT	12
 #define MMU_SMALL_PAGE_MASK	0xfff
 #define MMU_SMALL_PAGE_SIZE	0x1000
@@ -71,11 +92,46 @@
 #define MMU_TTBR_SHARED_WBWA \
 	(MMU_TTBR_S | MMU_TTBR_IRGN_WBWA | MMU_TTBR_RNG_WBWA)
 
+/* Translation aborted */
+#define MMU_PAR_F		(1 << 0)
+/* Non-secure output address */
+#define MMU_PAR_NS		(1 << 9)
+
+
+STATIC_ASSERT(MMU_L2_NUM_TABLES <= 32);
+STATIC_ASSERT(MMU_PAGE_SIZE == MMU_SMALL_PAGE_SIZE);
 
 static struct {
 	uint32_t *l1_table;
+	uint32_t l2_used_map;	/* A set bit means the table is in use */
+	uint32_t xlat_gen;	/* Generation of valid mmu_xlat_cache entries */
 } mmu __attribute__((section(".bss.prebss.mmu")));
 
+static uint32_t mmu_l2_tables[MMU_L2_NUM_TABLES][MMU_L2_NUM_ENTRIES]
+	__attribute__((section(".bss.prebss.mmu"), aligned(MMU_L2_ALIGNMENT)));
+
+/*
+ * Serializes updates of the translation tables and l2_used_map, updates
+ * are done from both stdcalls and fastcalls. Taken with IRQ and FIQ
+ * masked as fastcalls can't wait for a preempted holder.
+ */
+static struct mutex mmu_lock = MUTEX_INITIALIZER;
+
+static uint32_t lock_tables(void)
+{
+	uint32_t cpsr = read_cpsr();
+
+	write_cpsr(cpsr | CPSR_F | CPSR_I);
+	mutex_lock(&mmu_lock);
+	return cpsr;
+}
+
+static void unlock_tables(uint32_t cpsr)
+{
+	mutex_unlock(&mmu_lock);
+	write_cpsr(cpsr);
+}
+
 static uint32_t create_romem_block(uintptr_t addr, bool ns)
 {
 	uint32_t attrs;
@@ -108,6 +164,24 @@ static uint32_t create_rwmem_block(uintptr_t addr, bool ns)
 	return (addr & ~MMU_SECTION_MASK) | attrs;
 }
 
+static uint32_t create_ns_mem_block(uintptr_t addr, uint32_t inner,
+		uint32_t outer)
+{
+	uint32_t attrs;
+
+	attrs = MMU_L1_TEX_CACHED | (outer << MMU_L1_TEX_SHIFT) |
+		((inner & 0x2) ? MMU_L1_C : 0) |
+		((inner & 0x1) ? MMU_L1_B : 0) |
+		MMU_L1_SECTION |
+		MMU_L1_S |	/* shared, global */
+		MMU_L1_XN |	/* Not executable */
+		0 |		/* RW PL1, other levels no access */
+		MMU_L1_AP0 |	/* Accessable */
+		MMU_L1_NS;
+
+	return (addr & ~MMU_SECTION_MASK) | attrs;
+}
+
 static uint32_t create_device_block(uintptr_t addr, bool ns)
 {
 	uint32_t attrs;
@@ -128,14 +202,322 @@ static uint32_t create_device_block(uintptr_t addr, bool ns)
 
 
 
+/* Converts a section entry into an equivalent small page entry */
+static uint32_t section_to_small_page(uint32_t section, uintptr_t addr)
+{
+	uint32_t tex = (section >> MMU_L1_TEX_SHIFT) & 0x7;
+	uint32_t entry = MMU_L2_SMALL_PAGE | (tex << MMU_L2_TEX_SHIFT);
+
+	if (section & MMU_L1_XN)
+		entry |= MMU_L2_XN;
+	if (section & MMU_L1_B)
+		entry |= MMU_L2_B;
+	if (section & MMU_L1_C)
+		entry |= MMU_L2_C;
+	if (section & MMU_L1_AP0)
+		entry |= MMU_L2_AP0;
+	if (section & MMU_L1_AP1)
+		entry |= MMU_L2_AP1;
+	if (section & MMU_L1_AP2)
+		entry |= MMU_L2_AP2;
+	if (section & MMU_L1_S)
+		entry |= MMU_L2_S;
+	if (section & MMU_L1_NG)
+		entry |= MMU_L2_NG;
+
+	return (addr & ~MMU_SMALL_PAGE_MASK) | entry;
+}
+
+static uint32_t create_small_page(paddr_t addr, uint32_t attrs)
+{
+	uint32_t entry;
+
+	entry = MMU_L2_SMALL_PAGE |
+		MMU_L2_S |	/* shared, global */
+		MMU_L2_AP0;	/* Accessable */
+
+	if (attrs & MMU_ATTR_DEVICE)
+		entry |= MMU_L2_B;
+	else
+		entry |= (0x1 << MMU_L2_TEX_SHIFT) | MMU_L2_B | MMU_L2_C;
+	if (attrs & MMU_ATTR_RO)
+		entry |= MMU_L2_AP2;	/* RO PL1, other levels no access */
+	if (attrs & MMU_ATTR_XN)
+		entry |= MMU_L2_XN;
+
+	return (addr & ~MMU_SMALL_PAGE_MASK) | entry;
+}
+
+static uint32_t *alloc_l2_table(void)
+{
+	size_t n;
+
+	for (n = 0; n < MMU_L2_NUM_TABLES; n++) {
+		if (!(mmu.l2_used_map & (1 << n))) {
+			mmu.l2_used_map |= 1 << n;
+			return mmu_l2_tables[n];
+		}
+	}
+	return NULL;
+}
+
+static void free_l2_table(uint32_t *l2)
+{
+	size_t n = ((uintptr_t)l2 - (uintptr_t)mmu_l2_tables) /
+		   sizeof(mmu_l2_tables[0]);
+
+	mmu.l2_used_map &= ~(1 << n);
+}
+
+/*
+ * Updates a first level entry, a second level table that's replaced is
+ * returned to the pool. *stride is lowered to the TLB invalidation
+ * stride needed for the replaced entry, see
+ * cache_tlb_invalidate_range(), and left alone if nothing changed.
+ */
+static void set_l1_entry(vaddr_t va, uint32_t entry, size_t *stride)
+{
+	uint32_t *l1e = &mmu.l1_table[va >> MMU_SECTION_SHIFT];
+	size_t s = MMU_SECTION_SIZE;
+
+	if (*l1e == entry)
+		return;
+	if ((*l1e & 0x3) == MMU_L1_PAGE_TBL) {
+		free_l2_table((uint32_t *)(*l1e & ~MMU_L2_TBL_MASK));
+		s = MMU_SMALL_PAGE_SIZE;
+	}
+	*l1e = entry;
+	if (!*stride || s < *stride)
+		*stride = s;
+}
+
+/* Invalidates all cached translations of all CPUs */
+static void xlat_cache_invalidate(void)
+{
+	mmu.xlat_gen++;
+	if (!mmu.xlat_gen)
+		mmu.xlat_gen++;	/* 0 is never valid */
+}
+
+/*
+ * Invalidates the TLB after the sections covering a range were updated.
+ * The translation caches are invalidated once the TLB invalidation has
+ * completed, a translation done before that may have used a stale TLB
+ * entry and is cached with the old generation.
+ */
+static void sections_updated(vaddr_t va, size_t len, size_t stride)
+{
+	vaddr_t start = va & ~MMU_SECTION_MASK;
+
+	if (stride) {
+		cache_tlb_invalidate_range(start, va + len - start, stride);
+		xlat_cache_invalidate();
+	}
+}
+
+static bool l1_entry_is_ns(uint32_t l1e)
+{
+	if ((l1e & 0x3) == MMU_L1_PAGE_TBL)
+		return l1e & MMU_L1_PT_NS;
+	return l1e & MMU_L1_NS;
+}
+
+/*
+ * Returns the second level table mapping va, the section mapping va is
+ * split into small pages if needed and an unmapped section gets an
+ * empty table. Returns NULL if the NS attribute of the section doesn't
+ * match ns, if no second level table is available or if the section is
+ * mapped and the MMU enabled.
+ *
+ * Replacing a live section with a table needs break-before-make, or the
+ * TLB may hold both for the same VA. The section would be unmapped
+ * meanwhile, which isn't possible for the sections holding the code,
+ * stacks and tables used while doing it. Mapped sections are instead
+ * only split by mmu_init() before the MMU is enabled. An unmapped
+ * section has no TLB entries, linking a table to it is always safe.
+ */
+static uint32_t *get_l2_table(vaddr_t va, bool ns)
+{
+	uint32_t *l1e = &mmu.l1_table[va >> MMU_SECTION_SHIFT];
+	uintptr_t section = va & ~MMU_SECTION_MASK;
+	uint32_t *l2;
+	size_t n;
+
+	if ((*l1e & 0x3) && l1_entry_is_ns(*l1e) != ns)
+		return NULL;
+
+	if ((*l1e & 0x3) == MMU_L1_PAGE_TBL)
+		return (uint32_t *)(*l1e & ~MMU_L2_TBL_MASK);
+	if ((*l1e & 0x3) && (read_sctlr() & SCTLR_M))
+		return NULL;
+
+	l2 = alloc_l2_table();
+	if (!l2)
+		return NULL;
+
+	for (n = 0; n < MMU_L2_NUM_ENTRIES; n++) {
+		if ((*l1e & 0x3) == MMU_L1_SECTION)
+			l2[n] = section_to_small_page(*l1e,
+					section + n * MMU_SMALL_PAGE_SIZE);
+		else
+			l2[n] = 0;
+	}
+
+	/* Make the table visible to the table walk before it's linked */
+	dsb();
+	/* Tables are identity mapped, VA is the same as PA */
+	*l1e = (uint32_t)l2 | MMU_L1_PAGE_TBL | (ns ? MMU_L1_PT_NS : 0);
+	return l2;
+}
+
+static uint32_t *get_l2_entry(vaddr_t va)
+{
+	uint32_t l1e = mmu.l1_table[va >> MMU_SECTION_SHIFT];
+	uint32_t *l2 = (uint32_t *)(l1e & ~MMU_L2_TBL_MASK);
+
+	return &l2[(va & MMU_SECTION_MASK) >> MMU_SMALL_PAGE_SHIFT];
+}
+
+/*
+ * Gets second level tables with the NS attribute *ns, or any if ns is
+ * NULL, for all sections of [va, end). If mapped is true every page of
+ * the range also has to be mapped already. On failure the sections
+ * split here are restored and their tables returned to the pool.
+ */
+static bool prepare_l2_tables(vaddr_t va, vaddr_t end, bool mapped,
+		const bool *ns)
+{
+	uint32_t split_l1e[MMU_L2_NUM_TABLES];
+	vaddr_t split_va[MMU_L2_NUM_TABLES];
+	size_t num_split = 0;
+	size_t stride = 0;
+	vaddr_t a;
+
+	for (a = va; a < end; a += MMU_SMALL_PAGE_SIZE) {
+		uint32_t l1e = mmu.l1_table[a >> MMU_SECTION_SHIFT];
+
+		if (mapped && !(l1e & 0x3))
+			goto err;
+		if (!get_l2_table(a, ns ? *ns : l1_entry_is_ns(l1e)))
+			goto err;
+		if ((l1e & 0x3) != MMU_L1_PAGE_TBL) {
+			split_l1e[num_split] = l1e;
+			split_va[num_split] = a;
+			num_split++;
+		}
+		if (mapped && !*get_l2_entry(a))
+			goto err;
+	}
+	return true;
+err:
+	while (num_split) {
+		num_split--;
+		set_l1_entry(split_va[num_split], split_l1e[num_split],
+			     &stride);
+	}
+	sections_updated(va, end - va, stride);
+	return false;
+}
+
+/* Invalidates the TLB after the pages of [va, end) were updated */
+static void pages_updated(vaddr_t va, vaddr_t end)
+{
+	cache_tlb_invalidate_range(va, end - va, MMU_SMALL_PAGE_SIZE);
+	xlat_cache_invalidate();
+}
+
+static bool map_pages(vaddr_t va, paddr_t pa, size_t len, uint32_t attrs)
+{
+	vaddr_t end = ROUNDUP(va + len, MMU_SMALL_PAGE_SIZE);
+	bool ns = attrs & MMU_ATTR_NS;
+	vaddr_t a;
+
+	pa = ROUNDDOWN(pa, MMU_SMALL_PAGE_SIZE);
+	va = ROUNDDOWN(va, MMU_SMALL_PAGE_SIZE);
+	if (!prepare_l2_tables(va, end, false, &ns))
+		return false;
+
+	for (a = va; a < end; a += MMU_SMALL_PAGE_SIZE)
+		*get_l2_entry(a) = create_small_page(pa + (a - va), attrs);
+	pages_updated(va, end);
+	return true;
+}
+
+static bool unmap_pages(vaddr_t va, size_t len)
+{
+	vaddr_t end = ROUNDUP(va + len, MMU_SMALL_PAGE_SIZE);
+	vaddr_t a;
+
+	va = ROUNDDOWN(va, MMU_SMALL_PAGE_SIZE);
+	if (!prepare_l2_tables(va, end, true, NULL))
+		return false;
+
+	for (a = va; a < end; a += MMU_SMALL_PAGE_SIZE)
+		*get_l2_entry(a) = 0;
+	pages_updated(va, end);
+	return true;
+}
+
+static bool set_page_attrs(vaddr_t va, size_t len, uint32_t attrs)
+{
+	vaddr_t end = ROUNDUP(va + len, MMU_SMALL_PAGE_SIZE);
+	bool ns = attrs & MMU_ATTR_NS;
+	vaddr_t a;
+
+	va = ROUNDDOWN(va, MMU_SMALL_PAGE_SIZE);
+	if (!prepare_l2_tables(va, end, true, &ns))
+		return false;
+
+	for (a = va; a < end; a += MMU_SMALL_PAGE_SIZE) {
+		uint32_t *l2e = get_l2_entry(a);
+
+		*l2e = create_small_page(*l2e, attrs);
+	}
+	pages_updated(va, end);
+	return true;
+}
+
+bool mmu_map_pages(vaddr_t va, paddr_t pa, size_t len, uint32_t attrs)
+{
+	uint32_t cpsr = lock_tables();
+	bool ret = map_pages(va, pa, len, attrs);
+
+	unlock_tables(cpsr);
+	return ret;
+}
+
+bool mmu_unmap_pages(vaddr_t va, size_t len)
+{
+	uint32_t cpsr = lock_tables();
+	bool ret = unmap_pages(va, len);
+
+	unlock_tables(cpsr);
+	return ret;
+}
+
+bool mmu_set_page_attrs(vaddr_t va, size_t len, uint32_t attrs)
+{
+	uint32_t cpsr = lock_tables();
+	bool ret = set_page_attrs(va, len, attrs);
+
+	unlock_tables(cpsr);
+	return ret;
+}
+
+bool mmu_map_guard_page(vaddr_t va)
+{
+	return mmu_unmap_pages(va, MMU_SMALL_PAGE_SIZE);
+}
+
 void mmu_init(uint32_t *l1_table, uintptr_t code_start, uintptr_t code_end,
 	uintptr_t data_start, uintptr_t data_end)
 {
 	size_t n;
-	uint32_t sctlr;
 	uintptr_t a;
 
 	mmu.l1_table = l1_table;
+	mmu.l2_used_map = 0;
+	mmu.xlat_gen = 1;
 
 	for (n = 0; n < MMU_L1_NUM_ENTRIES; n++)
 		mmu.l1_table[n] = 0;
@@ -154,7 +536,22 @@ void mmu_init(uint32_t *l1_table, uintptr_t code_start, uintptr_t code_end,
 			create_rwmem_block(a, false);
 	}
 
-	write_ttbr0((uint32_t)l1_table | MMU_TTBR_SHARED_WBWA);
+	/*
+	 * Tighten the permissions at small page granularity, code read-only
+	 * and data not executable. The section mappings are kept if the
+	 * table pool is exhausted. No lock as the MMU is still off.
+	 */
+	set_page_attrs(code_start, code_end - code_start, MMU_ATTR_RO);
+	set_page_attrs(data_start, data_end - data_start, MMU_ATTR_XN);
+
+	mmu_enable();
+}
+
+void mmu_enable(void)
+{
+	uint32_t sctlr;
+
+	write_ttbr0((uint32_t)mmu.l1_table | MMU_TTBR_SHARED_WBWA);
 
 	/*
 	 * Set as client to domain0, all other disabled. MMU entries mapped
@@ -174,44 +571,204 @@ void mmu_init(uint32_t *l1_table, uintptr_t code_start, uintptr_t code_end,
 
 vaddr_t mmu_map_device(paddr_t addr, size_t len)
 {
+	uint32_t cpsr = lock_tables();
 	paddr_t a;
-	bool inv_needed = false;
-
-	for (a = addr & ~MMU_SECTION_MASK; a < (addr + len);
-			a += MMU_SECTION_SIZE) {
-		uint32_t entry = create_device_block(addr, false);
-
-		if (mmu.l1_table[a >> MMU_SECTION_SHIFT] != entry) {
-			mmu.l1_table[a >> MMU_SECTION_SHIFT] =
-				create_device_block(a, false);
-			inv_needed = true;
-		}
+	size_t stride = 0;
+
+	/* Only the pages of the device, sections if the pool is exhausted */
+	if (!map_pages(addr, addr, len, MMU_ATTR_DEVICE | MMU_ATTR_XN)) {
+		for (a = addr & ~MMU_SECTION_MASK; a < (addr + len);
+				a += MMU_SECTION_SIZE)
+			set_l1_entry(a, create_device_block(a, false),
+				     &stride);
+		sections_updated(addr, len, stride);
 	}
-	/* TODO only invalidate range */
-	if (inv_needed)
-		cache_tlb_invalidate();
 
+	unlock_tables(cpsr);
 	return addr;
 }
 
 vaddr_t mmu_map_rwmem(paddr_t addr, size_t len, bool ns)
 {
+	uint32_t cpsr = lock_tables();
 	paddr_t a;
-	bool inv_needed = false;
+	size_t stride = 0;
 
 	for (a = addr & ~MMU_SECTION_MASK; a < (addr + len);
-			a += MMU_SECTION_SIZE) {
-		uint32_t entry = create_rwmem_block(addr, ns);
+			a += MMU_SECTION_SIZE)
+		set_l1_entry(a, create_device_block(a, ns), &stride);
+	sections_updated(addr, len, stride);
+
+	unlock_tables(cpsr);
+	return addr;
+}
+
+vaddr_t mmu_map_ns_mem(paddr_t addr, size_t len, uint32_t inner,
+		uint32_t outer)
+{
+	uint32_t cpsr = lock_tables();
+	paddr_t a;
+	size_t stride = 0;
+
+	for (a = addr & ~MMU_SECTION_MASK; a < (addr + len);
+			a += MMU_SECTION_SIZE)
+		set_l1_entry(a, create_ns_mem_block(a, inner, outer),
+			     &stride);
+	sections_updated(addr, len, stride);
+
+	unlock_tables(cpsr);
+	return addr;
+}
+
+/* Translates va with the MMU and caches the result, IRQ and FIQ masked */
+static paddr_t xlat_slow(vaddr_t va, uint32_t gen, struct mmu_xlat_entry *se,
+		struct mmu_xlat_entry *pe, bool *ns)
+{
+	uint32_t l1e = mmu.l1_table[va >> MMU_SECTION_SHIFT];
+	uint32_t par;
+
+	write_ats1cpr(va);
+	isb();
+	par = read_par();
+	if (par & MMU_PAR_F)
+		return 0;
+
+	if ((l1e & 0x3) == MMU_L1_SECTION) {
+		se->va = va & ~MMU_SECTION_MASK;
+		se->pa = par & ~MMU_SECTION_MASK;
+		se->ns = par & MMU_PAR_NS;
+		se->gen = gen;
+		*ns = se->ns;
+	} else {
+		pe->va = va & ~MMU_SMALL_PAGE_MASK;
+		pe->pa = par & ~MMU_SMALL_PAGE_MASK;
+		pe->ns = par & MMU_PAR_NS;
+		pe->gen = gen;
+		*ns = pe->ns;
+	}
+
+	return (par & ~MMU_SMALL_PAGE_MASK) | (va & MMU_SMALL_PAGE_MASK);
+}
+
+/* Same as mmu_virt_to_phys(), *ns is set if pa is non-secure */
+static paddr_t virt_to_phys(vaddr_t va, bool *ns)
+{
+	uint32_t gen = *(volatile uint32_t *)&mmu.xlat_gen;
+	uint32_t cpsr = read_cpsr();
+	struct mmu_xlat_cache *c;
+	struct mmu_xlat_entry *se;
+	struct mmu_xlat_entry *pe;
+	paddr_t pa;
+
+	/* Stay on this CPU and keep the FIQ handler out while using PAR */
+	write_cpsr(cpsr | CPSR_F | CPSR_I);
+
+	c = &get_percpu()->mmu_xlat_cache;
+	se = &c->sections[(va >> MMU_SECTION_SHIFT) % MMU_XLAT_CACHE_SIZE];
+	pe = &c->pages[(va >> MMU_SMALL_PAGE_SHIFT) % MMU_XLAT_CACHE_SIZE];
+
+	if (se->gen == gen && se->va == (va & ~MMU_SECTION_MASK)) {
+		pa = se->pa | (va & MMU_SECTION_MASK);
+		*ns = se->ns;
+	} else if (pe->gen == gen && pe->va == (va & ~MMU_SMALL_PAGE_MASK)) {
+		pa = pe->pa | (va & MMU_SMALL_PAGE_MASK);
+		*ns = pe->ns;
+	} else {
+		pa = xlat_slow(va, gen, se, pe, ns);
+	}
+
+	write_cpsr(cpsr);
+	return pa;
+}
+
+paddr_t mmu_virt_to_phys(vaddr_t va)
+{
+	bool ns;
 
-		if (mmu.l1_table[a >> MMU_SECTION_SHIFT] != entry) {
-			mmu.l1_table[a >> MMU_SECTION_SHIFT] =
-				create_device_block(a, ns);
-			inv_needed = true;
+	return virt_to_phys(va, &ns);
+}
+
+/*
+ * Searches the translation tables for a mapping of pa, only non-secure
+ * mappings if ns_only is true
+ */
+static vaddr_t find_va(paddr_t pa, bool ns_only)
+{
+	size_t n;
+	size_t m;
+
+	for (n = 0; n < MMU_L1_NUM_ENTRIES; n++) {
+		uint32_t l1e = mmu.l1_table[n];
+		uint32_t *l2;
+
+		if ((l1e & 0x3) && ns_only && !l1_entry_is_ns(l1e))
+			continue;
+		if ((l1e & 0x3) == MMU_L1_SECTION) {
+			if ((l1e & ~MMU_SECTION_MASK) == (pa & ~MMU_SECTION_MASK))
+				return (n << MMU_SECTION_SHIFT) |
+				       (pa & MMU_SECTION_MASK);
+			continue;
+		}
+		if ((l1e & 0x3) != MMU_L1_PAGE_TBL)
+			continue;
+
+		l2 = (uint32_t *)(l1e & ~MMU_L2_TBL_MASK);
+		for (m = 0; m < MMU_L2_NUM_ENTRIES; m++) {
+			if ((l2[m] & MMU_L2_SMALL_PAGE) &&
+			    (l2[m] & ~MMU_SMALL_PAGE_MASK) ==
+			    (pa & ~MMU_SMALL_PAGE_MASK))
+				return (n << MMU_SECTION_SHIFT) |
+				       (m << MMU_SMALL_PAGE_SHIFT) |
+				       (pa & MMU_SMALL_PAGE_MASK);
 		}
 	}
-	/* TODO only invalidate range */
-	if (inv_needed)
-		cache_tlb_invalidate();
 
-	return addr;
+	return 0;
+}
+
+vaddr_t mmu_phys_to_virt(paddr_t pa)
+{
+	uint32_t cpsr;
+	vaddr_t va;
+
+	/* Everything is identity mapped unless mapped otherwise */
+	if (mmu_virt_to_phys(pa) == pa)
+		return pa;
+
+	/* Keeps the tables from changing under the search */
+	cpsr = lock_tables();
+	va = find_va(pa, false);
+	unlock_tables(cpsr);
+	return va;
+}
+
+vaddr_t mmu_ns_phys_to_virt(paddr_t pa, size_t len)
+{
+	uint32_t cpsr;
+	vaddr_t va;
+	size_t offs;
+	bool ns;
+
+	if (!len)
+		len = 1;
+	if (pa + len - 1 < pa)
+		return 0;
+
+	if (virt_to_phys(pa, &ns) == pa && ns) {
+		va = pa;
+	} else {
+		cpsr = lock_tables();
+		va = find_va(pa, true);
+		unlock_tables(cpsr);
+	}
+	if (!va || va + len - 1 < va)
+		return 0;
+
+	/* The first page is checked above, check the rest of the range */
+	for (offs = MMU_SMALL_PAGE_SIZE - (va & MMU_SMALL_PAGE_MASK);
+	     offs < len; offs += MMU_SMALL_PAGE_SIZE) {
+		if (virt_to_phys(va + offs, &ns) != pa + offs || !ns)
+			return 0;
+	}
+	return va;
 }
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2014, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <kern/percpu.h>
+#include <kern/kern.h>
+#include <kern/misc.h>
+#include <kern/panic.h>
+#include <arm32.h>
+#include <plat.h>
+#include <stddef.h>
+
+STATIC_ASSERT(offsetof(struct percpu, sm_nsec_ctx) ==
+	      PERCPU_SM_NSEC_CTX_OFFS);
+STATIC_ASSERT(offsetof(struct percpu, sm_sec_ctx) == PERCPU_SM_SEC_CTX_OFFS);
+STATIC_ASSERT(offsetof(struct percpu, fiq_entry_cycles) ==
+	      PERCPU_FIQ_ENTRY_CYCLES_OFFS);
+
+/*
+ * Only the address of each entry is used before BSS is cleared, so
+ * this can stay in ordinary BSS.
+ */
+static struct percpu percpu[NUM_CPUS];
+
+void percpu_init(void)
+{
+	size_t pos = get_core_pos();
+
+	if (pos >= NUM_CPUS)
+		panic();
+	write_tpidrprw((uint32_t)&percpu[pos]);
+
+#ifdef WITH_THREAD_CYCLE_STATS
+	/* The cycle counter used for the thread statistics is per CPU */
+	write_pmcr(read_pmcr() | PMCR_E);
+	write_pmcntenset(PMCNTENSET_C);
+#endif
+}
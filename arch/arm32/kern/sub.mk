@@ -5,5 +5,7 @@ srcs-y += entry.S
 srcs-y += main.c
 srcs-y += misc.S
 srcs-y += mutex_asm.S
+srcs-y += percpu.c
 srcs-y += thread_asm.S
 srcs-y += thread.c
+srcs-y += thread_rpc_pool.c
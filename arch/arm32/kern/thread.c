@@ -29,16 +29,61 @@
 #include "thread_private.h"
 #include <sm/teesmc.h>
 #include <arm32.h>
+#include <plat.h>
+#include <kern/atomic.h>
 #include <kern/mutex.h>
+#include <kern/resmem.h>
+#include <kern/kern.h>
 #include <kern/misc.h>
+#include <kern/mmu.h>
+#include <kern/percpu.h>
 #include <kern/arch_debug.h>
+#include <kern/panic.h>
 #include <kprintf.h>
 
 #include <assert.h>
 
-static struct thread_ctx threads[NUM_THREADS];
+static struct thread_ctx threads[NUM_THREADS_MAX];
 
-static struct thread_core_local thread_core_local[NUM_CPUS];
+/*
+ * Bitmap of free threads, a set bit means that the thread is free and
+ * has a stack assigned. Updated with atomic_cas32() only, which makes
+ * allocating and freeing a thread independent of any global lock.
+ */
+#define THREAD_FREE_MAP_WORDS	((NUM_THREADS_MAX + 31) / 32)
+static uint32_t thread_free_map[THREAD_FREE_MAP_WORDS];
+
+/*
+ * Memory for the stacks of all NUM_THREADS_MAX threads is allocated from
+ * reserved memory at boot, as resmem is boot only. Threads [0, num_stacks)
+ * have their stack set up, the lock is only taken when the pool grows.
+ * num_stacks is published after the stack with a barrier so it can be
+ * read without the lock.
+ */
+static struct {
+	size_t stack_size;
+	size_t num_stacks;
+	uint32_t *stacks[NUM_THREADS_MAX];
+} thread_pool;
+static struct mutex thread_pool_lock = MUTEX_INITIALIZER;
+
+/*
+ * Admission queue for stdcalls that found no free thread. Callers are
+ * given increasing tickets and each freed thread wakes the oldest
+ * ticket not yet woken. Only used on the slow path. The freed thread
+ * isn't reserved for the woken caller, it's only told when to retry
+ * and may be beaten to the thread by a new call, so there's no FIFO
+ * guarantee.
+ */
+static struct {
+	uint32_t head;		/* Last ticket woken */
+	uint32_t tail;		/* Last ticket handed out */
+	uint32_t num_canceled;	/* Tickets not yet woken but not waiting */
+} thread_wait_queue;
+static struct mutex thread_wait_queue_lock = MUTEX_INITIALIZER;
+
+/* The state is updated with atomic_cas32() */
+STATIC_ASSERT(sizeof(enum thread_state) == sizeof(uint32_t));
 
 thread_call_handler_t thread_stdcall_handler_ptr;
 static thread_call_handler_t thread_fastcall_handler_ptr;
@@ -46,70 +91,434 @@ thread_fiq_handler_t thread_fiq_handler_ptr;
 thread_svc_handler_t thread_svc_handler_ptr;
 thread_abort_handler_t thread_abort_handler_ptr;
 
-static struct mutex thread_global_lock = MUTEX_INITIALIZER;
+static bool set_thread_state(size_t n, enum thread_state old_state,
+		enum thread_state new_state)
+{
+	return atomic_cas32((uint32_t *)&threads[n].state, old_state,
+			    new_state);
+}
 
-static void lock_global(void)
+/* Claims the lowest free thread, returns -1 if all threads are in use */
+static int claim_free_thread(void)
 {
-	mutex_lock(&thread_global_lock);
+	size_t w;
+
+	for (w = 0; w < THREAD_FREE_MAP_WORDS; w++) {
+		uint32_t old_map;
+		uint32_t bit;
+
+		do {
+			old_map = thread_free_map[w];
+			if (!old_map)
+				break;
+			bit = old_map & -old_map; /* Isolate lowest set bit */
+		} while (!atomic_cas32(&thread_free_map[w], old_map,
+				       old_map & ~bit));
+
+		if (old_map)
+			return w * 32 + __builtin_ctz(bit);
+	}
+
+	return -1;
 }
 
-static void unlock_global(void)
+static void release_free_thread(size_t n)
 {
-	mutex_unlock(&thread_global_lock);
+	uint32_t *map = &thread_free_map[n / 32];
+	uint32_t bit = 1 << (n % 32);
+	uint32_t old_map;
+
+	do {
+		old_map = *map;
+		assert(!(old_map & bit));
+	} while (!atomic_cas32(map, old_map, old_map | bit));
 }
 
 static struct thread_core_local *get_core_local(void)
 {
-	struct thread_core_local *l;
-	uint32_t cpu_id = get_core_pos();
+	return &get_percpu()->thread_core_local;
+}
+
+/*
+ * Returns the thread running on the current CPU, -1 if none. A thread
+ * can be preempted and resumed on another CPU at any instruction with
+ * interrupts unmasked, curr_thread is read with them masked so it's
+ * taken from the CPU the thread runs on. The index is the same on
+ * every CPU.
+ */
+static int thread_get_id(void)
+{
+	uint32_t cpsr = read_cpsr();
+	int ct;
+
+	write_cpsr(cpsr | CPSR_F | CPSR_I);
+	ct = get_core_local()->curr_thread;
+	write_cpsr(cpsr);
+
+	return ct;
+}
+
+/*
+ * The locks below are taken with IRQ and FIQ masked, a holder can't be
+ * time sliced out while another CPU spins on the lock.
+ */
+static uint32_t thread_lock(struct mutex *m)
+{
+	uint32_t cpsr = read_cpsr();
 
-	assert(cpu_id < NUM_CPUS);
-	l = &thread_core_local[cpu_id];
-	return l;
+	write_cpsr(cpsr | CPSR_F | CPSR_I);
+	mutex_lock(m);
+	return cpsr;
 }
 
-static bool have_one_active_thread(void)
+static void thread_unlock(struct mutex *m, uint32_t cpsr)
 {
+	mutex_unlock(m);
+	write_cpsr(cpsr);
+}
+
+/*
+ * Allocates memory for all stacks of the pool, called at boot only. The
+ * guard pages are unmapped here too, as updating the translation tables
+ * while other CPUs may use them isn't safe.
+ */
+static bool thread_pool_alloc_stacks(void)
+{
+	size_t size = thread_pool.stack_size + STACK_CANARY_SIZE;
 	size_t n;
 
-	for (n = 0; n < NUM_THREADS; n++) {
-		if (threads[n].state == THREAD_STATE_ACTIVE)
-			return true;
+	for (n = 0; n < NUM_THREADS_MAX; n++) {
+#ifdef WITH_STACK_GUARD_PAGES
+		thread_pool.stacks[n] = resmem_alloc_aligned(
+				STACK_GUARD_SIZE + size, STACK_GUARD_SIZE);
+		if (!thread_pool.stacks[n] ||
+		    !mmu_map_guard_page((vaddr_t)thread_pool.stacks[n]))
+			return false;
+		thread_pool.stacks[n] += STACK_GUARD_SIZE / sizeof(uint32_t);
+#else
+		thread_pool.stacks[n] = resmem_alloc(size);
+		if (!thread_pool.stacks[n])
+			return false;
+#endif
 	}
 
-	return false;
+	return true;
 }
 
-static void thread_alloc_and_run(struct thread_smc_args *args)
+static size_t thread_pool_num_stacks(void)
+{
+	size_t num_stacks = *(volatile size_t *)&thread_pool.num_stacks;
+
+	dmb();	/* Read num_stacks before the stacks it covers */
+	return num_stacks;
+}
+
+static bool thread_pool_add_stack(void)
+{
+	size_t n = thread_pool.num_stacks;
+	size_t size = thread_pool.stack_size + STACK_CANARY_SIZE;
+	uint32_t *stack;
+
+	if (n >= NUM_THREADS_MAX)
+		return false;
+	stack = thread_pool.stacks[n];
+
+#ifdef WITH_STACK_CANARIES
+	stack[0] = START_CANARY_VALUE;
+	stack[size / sizeof(uint32_t) - 1] = END_CANARY_VALUE;
+	stack_paint(stack + 1, stack + size / sizeof(uint32_t) - 1);
+#endif
+
+	if (!thread_init_stack(n, (vaddr_t)stack + size - STACK_CANARY_SIZE / 2))
+		return false;
+	dmb();	/* Set up the stack before num_stacks covers it */
+	thread_pool.num_stacks = n + 1;
+	return true;
+}
+
+/* Adds one more thread to the pool, returns false if it can't grow */
+static bool thread_pool_grow(void)
+{
+	uint32_t cpsr;
+	bool ret;
+
+	cpsr = thread_lock(&thread_pool_lock);
+	ret = thread_pool_add_stack();
+	thread_unlock(&thread_pool_lock, cpsr);
+
+	return ret;
+}
+
+static uint32_t wait_queue_next(uint32_t ticket)
+{
+	ticket++;
+	if (!ticket)
+		ticket++; /* 0 means no ticket */
+	return ticket;
+}
+
+static uint32_t thread_wait_queue_add(void)
+{
+	uint32_t ticket;
+	uint32_t cpsr;
+
+	cpsr = thread_lock(&thread_wait_queue_lock);
+	thread_wait_queue.tail = wait_queue_next(thread_wait_queue.tail);
+	ticket = thread_wait_queue.tail;
+	thread_unlock(&thread_wait_queue_lock, cpsr);
+
+	/* Publish the ticket before the caller checks for a free thread */
+	dmb();
+	return ticket;
+}
+
+/*
+ * Withdraws a ticket from thread_wait_queue_add() whose caller got a
+ * thread after all. The ticket can't be removed from the middle of the
+ * queue, instead the next wake skips one extra ticket so a waiting
+ * caller isn't left behind the canceled one.
+ */
+static void thread_wait_queue_cancel(uint32_t ticket)
+{
+	uint32_t cpsr;
+
+	cpsr = thread_lock(&thread_wait_queue_lock);
+	/* Already woken tickets need no compensation */
+	if ((int32_t)(ticket - thread_wait_queue.head) > 0)
+		thread_wait_queue.num_canceled++;
+	thread_unlock(&thread_wait_queue_lock, cpsr);
+}
+
+static uint32_t thread_wait_queue_wake_one(void)
+{
+	uint32_t ticket = 0;
+	uint32_t cpsr;
+
+	/*
+	 * Racy check to keep the lock off the fast path. The caller has
+	 * released a thread with a barrier, so a concurrent
+	 * thread_wait_queue_add() either is seen here or its caller sees
+	 * the released thread when it retries.
+	 */
+	if (*(volatile uint32_t *)&thread_wait_queue.head ==
+	    *(volatile uint32_t *)&thread_wait_queue.tail)
+		return 0;
+
+	cpsr = thread_lock(&thread_wait_queue_lock);
+	if (thread_wait_queue.head != thread_wait_queue.tail) {
+		thread_wait_queue.head =
+			wait_queue_next(thread_wait_queue.head);
+		while (thread_wait_queue.num_canceled &&
+		       thread_wait_queue.head != thread_wait_queue.tail) {
+			thread_wait_queue.head =
+				wait_queue_next(thread_wait_queue.head);
+			thread_wait_queue.num_canceled--;
+		}
+		if (thread_wait_queue.head == thread_wait_queue.tail)
+			thread_wait_queue.num_canceled = 0;
+		ticket = thread_wait_queue.head;
+	}
+	thread_unlock(&thread_wait_queue_lock, cpsr);
+
+	return ticket;
+}
+
+#ifdef WITH_THREAD_CYCLE_STATS
+static struct thread_cycle_stats thread_cmd_stats[THREAD_STATS_NUM_CMDS];
+static struct thread_cycle_stats thread_clnt_stats[THREAD_STATS_NUM_CLNTS];
+static struct mutex thread_stats_lock = MUTEX_INITIALIZER;
+#endif
+
+static void thread_cycles_start(size_t n)
+{
+#ifdef WITH_THREAD_CYCLE_STATS
+	threads[n].cycles_start = read_pmccntr();
+#endif
+}
+
+static void thread_cycles_stop(size_t n)
+{
+#ifdef WITH_THREAD_CYCLE_STATS
+	/* Unsigned arithmetic handles a wrapped cycle counter */
+	threads[n].cycles += read_pmccntr() - threads[n].cycles_start;
+#endif
+}
+
+#ifdef WITH_THREAD_CYCLE_STATS
+static size_t clnt_stats_idx(uint32_t hyp_clnt_id)
+{
+	if (hyp_clnt_id < THREAD_STATS_NUM_CLNTS)
+		return hyp_clnt_id;
+	return THREAD_STATS_NUM_CLNTS - 1;
+}
+#endif
+
+static void thread_rpc_cycles_start(size_t n)
+{
+#ifdef WITH_THREAD_CYCLE_STATS
+	threads[n].rpc_cycles_start = read_pmccntr();
+#endif
+}
+
+/*
+ * Adds the cycles since thread_rpc_cycles_start() to s of the current
+ * CPU, interrupts have to be masked.
+ */
+static void thread_rpc_cycles_add(size_t n, struct thread_cycle_stats *s)
+{
+#ifdef WITH_THREAD_CYCLE_STATS
+	s->cycles += read_pmccntr() - threads[n].rpc_cycles_start;
+	s->num_calls++;
+#endif
+}
+
+/* Adds the cycles consumed by the exiting thread to the statistics */
+static void thread_cycles_publish(size_t n)
+{
+#ifdef WITH_THREAD_CYCLE_STATS
+	struct thread_cycle_stats *s;
+	uint32_t cpsr;
+
+	cpsr = thread_lock(&thread_stats_lock);
+	s = &thread_cmd_stats[threads[n].stats_cmd];
+	s->cycles += threads[n].cycles;
+	s->num_calls++;
+	s = &thread_clnt_stats[clnt_stats_idx(threads[n].hyp_clnt_id)];
+	s->cycles += threads[n].cycles;
+	s->num_calls++;
+	thread_unlock(&thread_stats_lock, cpsr);
+#endif
+}
+
+static void thread_sched_start_slice(void)
+{
+#if THREAD_SCHED_POLICY == THREAD_SCHED_TIME_SLICED
+	write_cntp_tval(read_cntfrq() / 1000 * THREAD_TIME_SLICE_MS);
+	write_cntp_ctl(CNTP_CTL_ENABLE);
+#endif
+}
+
+static void thread_sched_stop_slice(void)
+{
+#if THREAD_SCHED_POLICY == THREAD_SCHED_TIME_SLICED
+	write_cntp_ctl(0);
+#endif
+}
+
+/* Claims a canceled thread suspended in normal world, -1 if none */
+static int claim_canceled_thread(void)
 {
 	size_t n;
+
+	for (n = 0; n < NUM_THREADS_MAX; n++) {
+		if (*(volatile uint32_t *)&threads[n].cancel_id ==
+		    THREAD_CANCEL_ID_CANCELED &&
+		    set_thread_state(n, THREAD_STATE_SUSPENDED,
+				     THREAD_STATE_ACTIVE))
+			return n;
+	}
+
+	return -1;
+}
+
+/* Resumes the claimed canceled thread n to unwind it, doesn't return */
+static void thread_reclaim(size_t n, uint32_t rv[THREAD_RECLAIM_NUM_RV],
+		uint32_t hyp_clnt_id)
+{
 	struct thread_core_local *l = get_core_local();
-	bool found_thread = false;
 
 	assert(l->curr_thread == -1);
+	l->curr_thread = n;
 
-	lock_global();
+	/*
+	 * The values are kept with the thread as it may be suspended
+	 * again and resumed on any CPU before it completes. The thread
+	 * now runs on behalf of the caller, which is the one to resume it.
+	 */
+	threads[n].reclaim_rv[0] = rv[0];
+	threads[n].reclaim_rv[1] = rv[1];
+	threads[n].reclaim_rv[2] = rv[2];
+	threads[n].reclaim_rv[3] = rv[3];
+	threads[n].flags |= THREAD_FLAGS_RECLAIMED;
+	threads[n].hyp_clnt_id = hyp_clnt_id;
 
-	if (!have_one_active_thread()) {
-		for (n = 0; n < NUM_THREADS; n++) {
-			if (threads[n].state == THREAD_STATE_FREE) {
-				threads[n].state = THREAD_STATE_ACTIVE;
-				found_thread = true;
-				break;
-			}
-		}
+	/*
+	 * A thread suspended in thread_rpc() sees a failed RPC with all
+	 * returned values cleared, the RPC functions then report the
+	 * cancellation.
+	 */
+	if (threads[n].flags & THREAD_FLAGS_COPY_ARGS_ON_RETURN) {
+		threads[n].regs.r0 = 0;
+		threads[n].regs.r1 = 0;
+		threads[n].regs.r2 = 0;
+		threads[n].regs.r3 = 0;
+		threads[n].regs.r4 = 0;
+		threads[n].regs.r5 = 0;
+		threads[n].regs.r6 = 0;
+		threads[n].flags &= ~THREAD_FLAGS_COPY_ARGS_ON_RETURN;
+		thread_rpc_cycles_start(n);
 	}
 
-	unlock_global();
+	thread_cycles_start(n);
+	thread_sched_start_slice();
+	thread_resume(&threads[n].regs);
+}
 
-	if (!found_thread) {
-		args->a0 = TEESMC_RETURN_EBUSY;
-		args->a1 = 0;
-		args->a2 = 0;
-		args->a3 = 0;
+/*
+ * All threads may be held by canceled calls, a stdcall finding no free
+ * thread unwinds one of them instead of waiting. The caller then gets
+ * TEESMC_RETURN_EBUSY to retry at once and take the freed thread, so
+ * its ticket is withdrawn and nobody else is woken.
+ */
+static void thread_reclaim_for_ewait(struct thread_smc_args *args,
+		uint32_t ticket)
+{
+	uint32_t rv[THREAD_RECLAIM_NUM_RV] = {
+		TEESMC_RETURN_EBUSY, args->a1, args->a2, args->a3 };
+	int n = claim_canceled_thread();
+
+	if (n == -1)
 		return;
+	thread_wait_queue_cancel(ticket);
+	thread_reclaim(n, rv, args->a7);
+}
+
+static void thread_alloc_and_run(struct thread_smc_args *args)
+{
+	int n;
+	struct thread_core_local *l = get_core_local();
+
+	assert(l->curr_thread == -1);
+
+	/*
+	 * Each CPU may have its own active thread, the state of a thread
+	 * is owned by the CPU that set it to THREAD_STATE_ACTIVE until
+	 * it's suspended or freed again.
+	 */
+	n = claim_free_thread();
+	while (n == -1 && thread_pool_grow())
+		n = claim_free_thread();
+	if (n == -1) {
+		uint32_t ticket = thread_wait_queue_add();
+
+		/*
+		 * A thread released before the ticket was added didn't wake
+		 * anyone, check again now that the ticket is visible.
+		 */
+		n = claim_free_thread();
+		if (n == -1) {
+			thread_reclaim_for_ewait(args, ticket);
+			args->a0 = TEESMC_RETURN_EWAIT;
+			args->a1 = ticket;
+			args->a2 = 0;
+			args->a3 = 0;
+			return;
+		}
+		thread_wait_queue_cancel(ticket);
 	}
 
+	if (!set_thread_state(n, THREAD_STATE_FREE, THREAD_STATE_ACTIVE))
+		panic();
 	l->curr_thread = n;
 
 	threads[n].regs.pc = (uint32_t)thread_stdcall_entry;
@@ -120,6 +529,8 @@ static void thread_alloc_and_run(struct thread_smc_args *args)
 		threads[n].regs.cpsr |= CPSR_T;
 	/* Reinitialize stack pointer */
 	threads[n].regs.svc_sp = threads[n].stack_va_end;
+	/* Only SVC mode is used until the thread enters other modes */
+	threads[n].regs.modes_used = 0;
 
 	/*
 	 * Copy arguments into context. This will make the
@@ -137,6 +548,11 @@ static void thread_alloc_and_run(struct thread_smc_args *args)
 	/* Save Hypervisor Client ID */
 	threads[n].hyp_clnt_id = args->a7;
 
+	threads[n].cycles = 0;
+	threads[n].stats_cmd = THREAD_STATS_CMD_OTHER;
+	threads[n].cancel_id = THREAD_CANCEL_ID_NONE;
+	thread_cycles_start(n);
+	thread_sched_start_slice();
 	thread_resume(&threads[n].regs);
 }
 
@@ -148,19 +564,13 @@ static void thread_resume_from_rpc(struct thread_smc_args *args)
 
 	assert(l->curr_thread == -1);
 
-	lock_global();
-
-	if (have_one_active_thread()) {
-		rv = TEESMC_RETURN_EBUSY;
-	} else if (n < NUM_THREADS &&
-		threads[n].state == THREAD_STATE_SUSPENDED &&
-		args->a7 == threads[n].hyp_clnt_id) {
-		threads[n].state = THREAD_STATE_ACTIVE;
-	} else {
+	/*
+	 * hyp_clnt_id only changes while the thread is active so it can
+	 * be checked before the thread is claimed.
+	 */
+	if (n >= NUM_THREADS_MAX || args->a7 != threads[n].hyp_clnt_id ||
+	    !set_thread_state(n, THREAD_STATE_SUSPENDED, THREAD_STATE_ACTIVE))
 		rv = TEESMC_RETURN_ERESUME;
-	}
-
-	unlock_global();
 
 	if (rv) {
 		args->a0 = rv;
@@ -185,15 +595,23 @@ static void thread_resume_from_rpc(struct thread_smc_args *args)
 		threads[n].regs.r1 = args->a1;
 		threads[n].regs.r2 = args->a2;
 		threads[n].regs.r3 = args->a3;
+		threads[n].regs.r4 = args->a4;
+		threads[n].regs.r5 = args->a5;
+		threads[n].regs.r6 = args->a6;
 		threads[n].flags &= ~THREAD_FLAGS_COPY_ARGS_ON_RETURN;
+		thread_rpc_cycles_start(n);
 	}
 
+	thread_cycles_start(n);
+	thread_sched_start_slice();
 	thread_resume(&threads[n].regs);
 }
 
 void thread_handle_smc_call(struct thread_smc_args *args)
 {
+#ifndef WITH_STACK_GUARD_PAGES
 	check_canaries();
+#endif
 
 	if (TEESMC_IS_FAST_CALL(args->a0)) {
 		thread_fastcall_handler_ptr(args);
@@ -212,20 +630,58 @@ void *thread_get_tmp_sp(void)
 	return (void *)l->tmp_stack_va_end;
 }
 
-void thread_state_free(void)
+uint32_t thread_state_free(uint32_t rv[THREAD_RECLAIM_NUM_RV])
 {
 	struct thread_core_local *l = get_core_local();
+	int ct = l->curr_thread;
+	uint32_t hyp_clnt_id;
+	uint32_t ticket;
+	bool reclaimed;
 
-	assert(l->curr_thread != -1);
+	assert(ct != -1);
 
-	lock_global();
+	thread_sched_stop_slice();
+	thread_cycles_stop(ct);
+	thread_cycles_publish(ct);
+
+	/* A reclaimed thread returns what the call reclaiming it returned */
+	reclaimed = threads[ct].flags & THREAD_FLAGS_RECLAIMED;
+	if (reclaimed) {
+		rv[0] = threads[ct].reclaim_rv[0];
+		rv[1] = threads[ct].reclaim_rv[1];
+		rv[2] = threads[ct].reclaim_rv[2];
+		rv[3] = threads[ct].reclaim_rv[3];
+	}
+	hyp_clnt_id = threads[ct].hyp_clnt_id;
 
-	assert(threads[l->curr_thread].state == THREAD_STATE_ACTIVE);
-	threads[l->curr_thread].state = THREAD_STATE_FREE;
-	threads[l->curr_thread].flags = 0;
+	threads[ct].flags = 0;
+	/* Stops late thread_cancel() calls from matching the old call */
+	threads[ct].cancel_id = THREAD_CANCEL_ID_NONE;
+	if (!set_thread_state(ct, THREAD_STATE_ACTIVE, THREAD_STATE_FREE))
+		panic();
 	l->curr_thread = -1;
 
-	unlock_global();
+	release_free_thread(ct);
+
+	/* See thread_reclaim_for_ewait() */
+	if (reclaimed && rv[0] == TEESMC_RETURN_EBUSY)
+		return hyp_clnt_id;
+
+	/* Tickets are handed out in order, the latest one to wake is kept */
+	ticket = thread_wait_queue_wake_one();
+	if (ticket)
+		rv[1] = ticket;
+
+	return hyp_clnt_id;
+}
+
+void thread_reclaim_canceled(uint32_t rv[THREAD_RECLAIM_NUM_RV],
+		uint32_t hyp_clnt_id)
+{
+	int n = claim_canceled_thread();
+
+	if (n != -1)
+		thread_reclaim(n, rv, hyp_clnt_id);
 }
 
 int thread_state_suspend(uint32_t flags, uint32_t cpsr, uint32_t pc)
@@ -235,20 +691,24 @@ int thread_state_suspend(uint32_t flags, uint32_t cpsr, uint32_t pc)
 
 	assert(ct != -1);
 
+#ifndef WITH_STACK_GUARD_PAGES
 	check_canaries();
+#endif
+	thread_sched_stop_slice();
+	thread_cycles_stop(ct);
+	l->preempt_pending = false;
 
-	lock_global();
-
-	assert(threads[ct].state == THREAD_STATE_ACTIVE);
 	threads[ct].flags &= ~THREAD_FLAGS_COPY_ARGS_ON_RETURN;
 	threads[ct].flags |= flags & THREAD_FLAGS_COPY_ARGS_ON_RETURN;
+	if (flags & THREAD_FLAGS_COPY_ARGS_ON_RETURN)
+		thread_rpc_cycles_add(ct, &get_percpu()->rpc_suspend);
 	threads[ct].regs.cpsr = cpsr;
 	threads[ct].regs.pc = pc;
-	threads[ct].state = THREAD_STATE_SUSPENDED;
+	/* Publishes the context above to the CPU resuming the thread */
+	if (!set_thread_state(ct, THREAD_STATE_ACTIVE, THREAD_STATE_SUSPENDED))
+		panic();
 	l->curr_thread = -1;
 
-	unlock_global();
-
 	return ct;
 }
 
@@ -273,17 +733,85 @@ bool thread_init_stack(uint32_t thread_id, vaddr_t sp)
 		break;
 
 	default:
-		if (thread_id >= NUM_THREADS)
-			return false;
-		if (threads[thread_id].state != THREAD_STATE_FREE)
-			return false;
+		{
+			bool had_stack;
+
+			if (thread_id >= NUM_THREADS_MAX)
+				return false;
+			if (threads[thread_id].state != THREAD_STATE_FREE)
+				return false;
+
+			had_stack = !!threads[thread_id].stack_va_end;
+			threads[thread_id].stack_va_end = sp;
+			/* Thread can be allocated once it has a stack */
+			if (!had_stack)
+				release_free_thread(thread_id);
+		}
+	}
+
+	return true;
+}
 
-		threads[thread_id].stack_va_end = sp;
+bool thread_init_pool(size_t stack_size, size_t num_threads)
+{
+	size_t n;
+
+	if (num_threads > NUM_THREADS_MAX ||
+	    stack_size != ROUNDUP(stack_size, STACK_ALIGMENT))
+		return false;
+
+	/* Use all of the pages between the guard pages */
+	thread_pool.stack_size = STACK_SLOT_SIZE(stack_size) -
+				 STACK_GUARD_SIZE - STACK_CANARY_SIZE;
+	if (!thread_pool_alloc_stacks())
+		return false;
+	for (n = 0; n < num_threads; n++) {
+		if (!thread_pool_add_stack())
+			return false;
 	}
 
 	return true;
 }
 
+void thread_check_canaries(void)
+{
+#ifdef WITH_STACK_CANARIES
+	size_t n;
+	size_t num_stacks = thread_pool_num_stacks();
+	size_t num_words = (thread_pool.stack_size + STACK_CANARY_SIZE) /
+			   sizeof(uint32_t);
+
+	for (n = 0; n < num_stacks; n++) {
+		uint32_t *end_canary = (uint32_t *)(threads[n].stack_va_end +
+					STACK_CANARY_SIZE / 2) - 1;
+		uint32_t *start_canary = end_canary - num_words + 1;
+
+		assert(*start_canary == START_CANARY_VALUE);
+		assert(*end_canary == END_CANARY_VALUE);
+	}
+#endif /*WITH_STACK_CANARIES*/
+}
+
+void thread_print_stack_usage(void)
+{
+#ifdef WITH_STACK_CANARIES
+	size_t n;
+	size_t num_stacks = thread_pool_num_stacks();
+	size_t num_words = (thread_pool.stack_size + STACK_CANARY_SIZE) /
+			   sizeof(uint32_t);
+
+	for (n = 0; n < num_stacks; n++) {
+		uint32_t *end_canary = (uint32_t *)(threads[n].stack_va_end +
+					STACK_CANARY_SIZE / 2) - 1;
+		uint32_t *start_canary = end_canary - num_words + 1;
+
+		kprintf("Stack thread[%zu]: max %zu of %zu bytes used\n", n,
+			stack_max_usage(start_canary + 1, end_canary),
+			thread_pool.stack_size);
+	}
+#endif /*WITH_STACK_CANARIES*/
+}
+
 void thread_init_handlers(const struct thread_handlers *handlers)
 {
 	thread_stdcall_handler_ptr = handlers->stdcall;
@@ -294,20 +822,24 @@ void thread_init_handlers(const struct thread_handlers *handlers)
 	thread_init_vbar();
 }
 
+void thread_init_secondary(void)
+{
+	thread_init_vbar();
+}
+
 void thread_set_tsd(void *tsd, thread_tsd_free_t free_func)
 {
-	struct thread_core_local *l = get_core_local();
+	int ct = thread_get_id();
 
-	assert(l->curr_thread != -1);
-	assert(threads[l->curr_thread].state == THREAD_STATE_ACTIVE);
-	threads[l->curr_thread].tsd = tsd;
-	threads[l->curr_thread].tsd_free = free_func;
+	assert(ct != -1);
+	assert(threads[ct].state == THREAD_STATE_ACTIVE);
+	threads[ct].tsd = tsd;
+	threads[ct].tsd_free = free_func;
 }
 
 void *thread_get_tsd(void)
 {
-	struct thread_core_local *l = get_core_local();
-	int ct = l->curr_thread;
+	int ct = thread_get_id();
 
 	if (ct == -1 || threads[ct].state != THREAD_STATE_ACTIVE)
 		return NULL;
@@ -323,17 +855,224 @@ struct thread_ctx_regs *thread_get_ctx_regs(void)
 	return &threads[l->curr_thread].regs;
 }
 
+void thread_set_stats_cmd(uint32_t cmd)
+{
+	int ct = thread_get_id();
+
+	if (ct == -1)
+		return;
+
+	if (cmd < THREAD_STATS_CMD_OTHER)
+		threads[ct].stats_cmd = cmd;
+	else
+		threads[ct].stats_cmd = THREAD_STATS_CMD_OTHER;
+}
+
+bool thread_get_cmd_cycle_stats(uint32_t cmd, struct thread_cycle_stats *stats)
+{
+#ifdef WITH_THREAD_CYCLE_STATS
+	uint32_t cpsr;
+
+	if (cmd >= THREAD_STATS_NUM_CMDS)
+		return false;
+
+	cpsr = thread_lock(&thread_stats_lock);
+	*stats = thread_cmd_stats[cmd];
+	thread_unlock(&thread_stats_lock, cpsr);
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool thread_get_clnt_cycle_stats(uint32_t hyp_clnt_id,
+		struct thread_cycle_stats *stats)
+{
+#ifdef WITH_THREAD_CYCLE_STATS
+	uint32_t cpsr = thread_lock(&thread_stats_lock);
+
+	*stats = thread_clnt_stats[clnt_stats_idx(hyp_clnt_id)];
+	thread_unlock(&thread_stats_lock, cpsr);
+	return true;
+#else
+	return false;
+#endif
+}
+
+void thread_fiq_latency_sample(void)
+{
+#ifdef WITH_THREAD_CYCLE_STATS
+	struct percpu *p = get_percpu();
+	struct thread_fiq_latency_stats *s = &p->fiq_latency;
+	uint32_t cycles = read_pmccntr() - p->fiq_entry_cycles;
+
+	if (!s->num_fiqs || cycles < s->min_cycles)
+		s->min_cycles = cycles;
+	if (cycles > s->max_cycles)
+		s->max_cycles = cycles;
+	s->cycles += cycles;
+	s->num_fiqs++;
+#endif
+}
+
+bool thread_get_rpc_switch_stats(struct thread_cycle_stats *suspend,
+		struct thread_cycle_stats *resume)
+{
+#ifdef WITH_THREAD_CYCLE_STATS
+	struct percpu *p;
+	uint32_t cpsr = read_cpsr();
+
+	write_cpsr(cpsr | CPSR_F | CPSR_I);
+	p = get_percpu();
+	*suspend = p->rpc_suspend;
+	*resume = p->rpc_resume;
+	write_cpsr(cpsr);
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool thread_get_fiq_latency_stats(struct thread_fiq_latency_stats *stats)
+{
+#ifdef WITH_THREAD_CYCLE_STATS
+	uint32_t cpsr = read_cpsr();
+
+	/* Stay on this CPU and keep the FIQ handler out while copying */
+	write_cpsr(cpsr | CPSR_F | CPSR_I);
+	*stats = get_percpu()->fiq_latency;
+	write_cpsr(cpsr);
+	return true;
+#else
+	return false;
+#endif
+}
+
+void thread_set_cancel_id(uint32_t id)
+{
+	int ct = thread_get_id();
+
+	assert(ct != -1);
+	assert(id != THREAD_CANCEL_ID_CANCELED);
+	*(volatile uint32_t *)&threads[ct].cancel_id = id;
+}
+
+bool thread_cancel(uint32_t id)
+{
+	bool ret = false;
+	size_t n;
+
+	if (id == THREAD_CANCEL_ID_NONE || id == THREAD_CANCEL_ID_CANCELED)
+		return false;
+
+	/* Fails if the call has completed and the id has been cleared */
+	for (n = 0; n < NUM_THREADS_MAX; n++)
+		if (atomic_cas32(&threads[n].cancel_id, id,
+				 THREAD_CANCEL_ID_CANCELED))
+			ret = true;
+
+	return ret;
+}
+
+bool thread_is_canceled(void)
+{
+	int ct = thread_get_id();
+
+	if (ct == -1)
+		return false;
+	return *(volatile uint32_t *)&threads[ct].cancel_id ==
+	       THREAD_CANCEL_ID_CANCELED;
+}
+
+void thread_sched_tick(void)
+{
+	struct thread_core_local *l = get_core_local();
+
+	thread_sched_stop_slice();
+	if (l->curr_thread != -1)
+		l->preempt_pending = true;
+}
+
+bool thread_fiq_check_preempt(uint32_t spsr)
+{
+	struct thread_core_local *l = get_core_local();
+
+	if (!l->preempt_pending)
+		return false;
+	l->preempt_pending = false;
+
+	if (l->curr_thread == -1)
+		return false;
+
+	/*
+	 * Threads are only preempted while executing in SVC mode, in other
+	 * modes the thread gets another slice instead. Spinning locks are
+	 * held with FIQ masked so a preempted thread never holds one.
+	 */
+	if ((spsr & CPSR_MODE_MASK) != CPSR_MODE_SVC) {
+		thread_sched_start_slice();
+		return false;
+	}
+
+	return true;
+}
+
+void thread_add_modes_used(uint32_t modes)
+{
+	struct thread_core_local *l = get_core_local();
+
+	if (l->curr_thread != -1)
+		threads[l->curr_thread].regs.modes_used |= modes;
+}
+
+/* thread_rpc() timing the suspend and resume of the current thread */
+static void thread_rpc_timed(uint32_t rv[THREAD_RPC_NUM_ARGS])
+{
+	int ct = thread_get_id();
+	uint32_t cpsr;
+
+	thread_rpc_cycles_start(ct);
+	thread_rpc(rv);
+
+	/* May be resumed on another CPU, the statistics are per CPU */
+	cpsr = read_cpsr();
+	write_cpsr(cpsr | CPSR_F | CPSR_I);
+	thread_rpc_cycles_add(ct, &get_percpu()->rpc_resume);
+	write_cpsr(cpsr);
+}
+
 void thread_rpc_alloc(size_t arg_size, size_t payload_size, paddr_t *arg,
 		paddr_t *payload)
 {
 	uint32_t rpc_args[THREAD_RPC_NUM_ARGS] = {
 		TEESMC_RETURN_RPC_ALLOC, arg_size, payload_size};
+	paddr_t a = 0;
+	paddr_t p = 0;
 
-	thread_rpc(rpc_args);
+	if (thread_is_canceled())
+		goto out;
+
+	/*
+	 * Use the pool donated by normal world if possible, both buffers
+	 * has to come from the same place as they're freed together.
+	 */
+	if (arg_size)
+		a = thread_rpc_pool_alloc(arg_size);
+	if (payload_size && (a || !arg_size))
+		p = thread_rpc_pool_alloc(payload_size);
+	if ((a || !arg_size) && (p || !payload_size) && (a || p))
+		goto out;
+	if (a)
+		thread_rpc_pool_free(a);
+
+	thread_rpc_timed(rpc_args);
+	a = rpc_args[1];
+	p = rpc_args[2];
+out:
 	if (arg)
-		*arg = rpc_args[1];
+		*arg = a;
 	if (payload)
-		*payload = rpc_args[2];
+		*payload = p;
 }
 
 void thread_rpc_free(paddr_t arg, paddr_t payload)
@@ -341,12 +1080,44 @@ void thread_rpc_free(paddr_t arg, paddr_t payload)
 	uint32_t rpc_args[THREAD_RPC_NUM_ARGS] = {
 		TEESMC_RETURN_RPC_FREE, arg, payload};
 
-	thread_rpc(rpc_args);
+	if (thread_rpc_pool_contains(arg) ||
+	    thread_rpc_pool_contains(payload)) {
+		if (arg)
+			thread_rpc_pool_free(arg);
+		if (payload)
+			thread_rpc_pool_free(payload);
+		return;
+	}
+
+	thread_rpc_timed(rpc_args);
 }
 
-void thread_rpc_cmd(paddr_t arg)
+bool thread_rpc_cmd(paddr_t arg)
 {
 	uint32_t rpc_args[THREAD_RPC_NUM_ARGS] = {TEESMC_RETURN_RPC_CMD, arg};
 
-	thread_rpc(rpc_args);
+	if (thread_is_canceled())
+		return false;
+	thread_rpc_timed(rpc_args);
+	/* Reclaimed by thread_reclaim_canceled() or canceled meanwhile */
+	return !thread_is_canceled();
+}
+
+uint32_t thread_rpc_cmd_regs(uint32_t cmd,
+		uint32_t vals[THREAD_RPC_NUM_REG_VALS])
+{
+	uint32_t rpc_args[THREAD_RPC_NUM_ARGS] = {
+		TEESMC_RETURN_RPC_CMD_REGS, cmd, vals[0], vals[1], vals[2],
+		vals[3] };
+
+	if (thread_is_canceled())
+		return TEESMC_ERROR_CANCEL;
+	thread_rpc_timed(rpc_args);
+	if (thread_is_canceled())
+		return TEESMC_ERROR_CANCEL;
+	vals[0] = rpc_args[2];
+	vals[1] = rpc_args[3];
+	vals[2] = rpc_args[4];
+	vals[3] = rpc_args[5];
+	return rpc_args[1];
 }
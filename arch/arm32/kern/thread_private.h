@@ -47,6 +47,7 @@ struct thread_ctx_regs {
 	uint32_t r10;
 	uint32_t r11;
 	uint32_t r12;
+	uint32_t modes_used;	/* THREAD_CTX_MODE_* */
 	uint32_t usr_spsr;
 	uint32_t usr_sp;
 	uint32_t usr_lr;
@@ -77,15 +78,15 @@ struct thread_ctx {
 	thread_tsd_free_t tsd_free;
 	uint32_t hyp_clnt_id;
 	uint32_t flags;
+	uint32_t cancel_id;	/* Updated with atomic_cas32() */
+	uint32_t stats_cmd;	/* Index into the command statistics */
+	uint32_t cycles_start;	/* PMCCNTR when last resumed */
+	uint32_t rpc_cycles_start; /* PMCCNTR when an RPC switch started */
+	uint32_t reclaim_rv[4];	/* See thread_reclaim_canceled() */
+	uint64_t cycles;	/* Cycles consumed by the current call */
 	struct thread_ctx_regs regs;
 };
 
-struct thread_core_local {
-	vaddr_t tmp_stack_va_end;
-	int curr_thread;
-};
-
-
 /*
  * Initializes VBAR for current CPU (called by thread_init_handlers()
  */
@@ -114,6 +115,19 @@ void *thread_get_tmp_sp(void);
 /* Handles an SMC call by disptaching to the correct handler */
 void thread_handle_smc_call(struct thread_smc_args *args);
 
+#define THREAD_RECLAIM_NUM_RV	4
+
+/*
+ * Called on the temporary stack with the values in rv to return to
+ * normal world, and the client id of the caller, when a stdcall has
+ * completed. A canceled thread suspended in normal world is resumed
+ * here to be unwound on behalf of the caller, in which case this
+ * function doesn't return. The values in rv are saved in the thread
+ * and returned once it has completed.
+ */
+void thread_reclaim_canceled(uint32_t rv[THREAD_RECLAIM_NUM_RV],
+		uint32_t hyp_clnt_id);
+
 /*
  * Marks the current thread as suspended. And updated the flags
  * for the thread context (see thread resume for use of flags).
@@ -122,13 +136,35 @@ void thread_handle_smc_call(struct thread_smc_args *args);
 int thread_state_suspend(uint32_t flags, uint32_t cpsr, uint32_t pc);
 
 /*
- * Marks the current thread as free.
+ * Marks the current thread as free. rv holds the values to return to
+ * normal world, they're replaced by the saved ones if the thread was
+ * reclaimed and rv[1] is set to the wait ticket of the queued stdcall
+ * that should retry now, if any. Returns the client id of the caller.
  */
-void thread_state_free(void);
+uint32_t thread_state_free(uint32_t rv[THREAD_RECLAIM_NUM_RV]);
 
 /* Returns a pointer to the saved registers in current thread context. */
 struct thread_ctx_regs *thread_get_ctx_regs(void);
 
+/*
+ * Records the cycles since sm_fiq_entry in the FIQ latency statistics,
+ * called before the FIQ handler for FIQs forwarded by the monitor.
+ */
+void thread_fiq_latency_sample(void);
+
+/*
+ * Adds THREAD_CTX_MODE_* bits to the banked modes used by the current
+ * thread, if any.
+ */
+void thread_add_modes_used(uint32_t modes);
+
+/*
+ * Called when returning from the FIQ handler with the SPSR of the
+ * interrupted context. Returns true if the interrupted thread is to be
+ * preempted, in which case it's suspended as if an IRQ was received.
+ */
+bool thread_fiq_check_preempt(uint32_t spsr);
+
 /* Sets sp for abort mode */
 void thread_set_abt_sp(vaddr_t sp);
 
@@ -147,8 +183,17 @@ extern thread_call_handler_t thread_stdcall_handler_ptr;
  * The purpose of this function is to request services from non-secure
  * world.
  */
-#define THREAD_RPC_NUM_ARGS     3
+/* rv[0-2] are passed in r0-r2 and rv[3-5] in r4-r6, r3 is the thread id */
+#define THREAD_RPC_NUM_ARGS     6
 void thread_rpc(uint32_t rv[THREAD_RPC_NUM_ARGS]);
 
+/*
+ * Sub-allocates from the RPC memory pool donated by normal world,
+ * returns 0 if the pool isn't registered or is exhausted.
+ */
+paddr_t thread_rpc_pool_alloc(size_t size);
+void thread_rpc_pool_free(paddr_t pa);
+bool thread_rpc_pool_contains(paddr_t pa);
+
 #endif /*THREAD_PRIVATE_H*/
 
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2014, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Sub-allocator for RPC argument and payload memory over a region of
+ * non-secure memory donated by normal world with
+ * TEESMC32_FASTCALL_REGISTER_RPC_POOL. The region is split evenly
+ * between a few size classes, each with a bitmap of free blocks updated
+ * with atomic_cas32() so no lock is needed.
+ */
+
+#include <kern/thread.h>
+#include "thread_private.h"
+#include <kern/atomic.h>
+#include <kern/kern.h>
+#include <arm32.h>
+#include <plat.h>
+#include <assert.h>
+
+#define RPC_POOL_NUM_CLASSES	4
+#define RPC_POOL_MIN_SHIFT	6	/* 64 bytes, 4 times more per class */
+#define RPC_POOL_MAX_BLOCKS	64	/* Blocks per size class */
+#define RPC_POOL_MAP_WORDS	(RPC_POOL_MAX_BLOCKS / 32)
+
+#define RPC_POOL_BLOCK_SIZE(c)	(1U << (RPC_POOL_MIN_SHIFT + 2 * (c)))
+
+struct rpc_pool_class {
+	paddr_t base;
+	size_t num_blocks;
+	uint32_t free_map[RPC_POOL_MAP_WORDS];
+};
+
+static struct {
+	uint32_t registered;
+	paddr_t begin;
+	paddr_t end;
+	struct rpc_pool_class classes[RPC_POOL_NUM_CLASSES];
+} rpc_pool;
+
+/* Claims the lowest free block, returns -1 if all blocks are in use */
+static int claim_block(struct rpc_pool_class *c)
+{
+	size_t w;
+
+	for (w = 0; w < RPC_POOL_MAP_WORDS; w++) {
+		uint32_t old_map;
+		uint32_t bit;
+
+		do {
+			old_map = c->free_map[w];
+			if (!old_map)
+				break;
+			bit = old_map & -old_map; /* Isolate lowest set bit */
+		} while (!atomic_cas32(&c->free_map[w], old_map,
+				       old_map & ~bit));
+
+		if (old_map)
+			return w * 32 + __builtin_ctz(bit);
+	}
+
+	return -1;
+}
+
+static void release_block(struct rpc_pool_class *c, size_t n)
+{
+	uint32_t *map = &c->free_map[n / 32];
+	uint32_t bit = 1 << (n % 32);
+	uint32_t old_map;
+
+	do {
+		old_map = *map;
+		assert(!(old_map & bit));
+	} while (!atomic_cas32(map, old_map, old_map | bit));
+}
+
+bool thread_rpc_pool_register(paddr_t pa, size_t size)
+{
+	size_t share = size / RPC_POOL_NUM_CLASSES;
+	paddr_t end = pa + size;
+	paddr_t base = pa;
+	uint32_t map;
+	size_t left;
+	size_t c;
+	size_t n;
+	size_t w;
+
+	if (!pa || (pa & (RPC_POOL_BLOCK_SIZE(0) - 1)) ||
+	    pa < DDR0_BASE || size > DDR0_SIZE ||
+	    pa - DDR0_BASE > DDR0_SIZE - size)
+		return false;
+	/* The pool can only be registered once */
+	if (!atomic_cas32(&rpc_pool.registered, 0, 1))
+		return false;
+
+	for (c = 0; c < RPC_POOL_NUM_CLASSES; c++) {
+		struct rpc_pool_class *cl = &rpc_pool.classes[c];
+
+		/* Rounding up the class starts may leave less than share */
+		left = base < end ? end - base : 0;
+		if (left > share)
+			left = share;
+		cl->base = base;
+		cl->num_blocks = left / RPC_POOL_BLOCK_SIZE(c);
+		if (cl->num_blocks > RPC_POOL_MAX_BLOCKS)
+			cl->num_blocks = RPC_POOL_MAX_BLOCKS;
+		base += ROUNDUP(share, RPC_POOL_BLOCK_SIZE(0));
+	}
+	rpc_pool.begin = pa;
+	rpc_pool.end = end;
+
+	/*
+	 * The blocks are published once the classes are set up. Each map
+	 * word is written with a single store, a block can be claimed as
+	 * soon as its word is stored and a read-modify-write would race
+	 * with claim_block().
+	 */
+	dmb();
+	for (c = 0; c < RPC_POOL_NUM_CLASSES; c++) {
+		for (w = 0; w < RPC_POOL_MAP_WORDS; w++) {
+			map = 0;
+			for (n = w * 32; n < rpc_pool.classes[c].num_blocks &&
+					 n < (w + 1) * 32; n++)
+				map |= 1 << (n % 32);
+			*(volatile uint32_t *)&rpc_pool.classes[c].free_map[w] =
+				map;
+		}
+	}
+
+	return true;
+}
+
+paddr_t thread_rpc_pool_alloc(size_t size)
+{
+	size_t c;
+	int n;
+
+	for (c = 0; c < RPC_POOL_NUM_CLASSES; c++) {
+		if (size > RPC_POOL_BLOCK_SIZE(c))
+			continue;
+		n = claim_block(&rpc_pool.classes[c]);
+		if (n >= 0)
+			return rpc_pool.classes[c].base +
+			       n * RPC_POOL_BLOCK_SIZE(c);
+	}
+
+	return 0;
+}
+
+bool thread_rpc_pool_contains(paddr_t pa)
+{
+	return pa >= rpc_pool.begin && pa < rpc_pool.end;
+}
+
+void thread_rpc_pool_free(paddr_t pa)
+{
+	size_t c;
+
+	for (c = RPC_POOL_NUM_CLASSES; c > 0; c--) {
+		struct rpc_pool_class *cl = &rpc_pool.classes[c - 1];
+
+		if (pa >= cl->base) {
+			release_block(cl, (pa - cl->base) /
+					  RPC_POOL_BLOCK_SIZE(c - 1));
+			return;
+		}
+	}
+	assert(0);
+}
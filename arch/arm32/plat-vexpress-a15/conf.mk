@@ -6,8 +6,38 @@ ARCH_DIR		 = arch/$(ARCH)
 PLATFORM_CPUARCH	 = cortex-a15
 PLATFORM_CFLAGS	 	 = -mcpu=$(PLATFORM_CPUARCH) -mthumb -fno-short-enums
 PLATFORM_SFLAGS	 	 = -mcpu=$(PLATFORM_CPUARCH)
-PLATFORM_CPPFLAGS	 = -I$(ARCH_DIR)/include -DNUM_CPUS=1 -DNUM_THREADS=2
+NUM_CPUS		?= 1
+# Threads with a stack allocated at boot, more are added on demand
+NUM_THREADS		?= 2
+NUM_THREADS_MAX		?= 8
+
+PLATFORM_CPPFLAGS	 = -I$(ARCH_DIR)/include
+PLATFORM_CPPFLAGS	+= -DNUM_CPUS=$(NUM_CPUS) -DNUM_THREADS=$(NUM_THREADS)
+PLATFORM_CPPFLAGS	+= -DNUM_THREADS_MAX=$(NUM_THREADS_MAX)
+
+# Secure thread scheduling, THREAD_SCHED_POLICY is one of 0 (run to
+# completion) or 1 (time sliced with THREAD_TIME_SLICE_MS long slices).
+# Secure world never switches between its own runnable threads on a
+# CPU. When a slice expires the thread is suspended and returned to
+# normal world as TEESMC_RETURN_RPC_IRQ, normal world decides when to
+# resume it, so which call runs next is up to the normal world
+# scheduler.
+THREAD_SCHED_POLICY	?= 1
+THREAD_TIME_SLICE_MS	?= 10
+PLATFORM_CPPFLAGS	+= -DTHREAD_SCHED_POLICY=$(THREAD_SCHED_POLICY)
+PLATFORM_CPPFLAGS	+= -DTHREAD_TIME_SLICE_MS=$(THREAD_TIME_SLICE_MS)
 PLATFORM_CPPFLAGS	+= -DWITH_STACK_CANARIES=1
+PLATFORM_CPPFLAGS	+= -DWITH_STACK_GUARD_PAGES=1
+PLATFORM_CPPFLAGS	+= -DWITH_THREAD_CYCLE_STATS=1
+
+# Size of the session table
+TEE_NUM_SESSIONS	?= 1024
+PLATFORM_CPPFLAGS	+= -DTEE_NUM_SESSIONS=$(TEE_NUM_SESSIONS)
+
+# Normal world entry, taken from lr at reset unless set
+ifneq ($(NSEC_ENTRY),)
+PLATFORM_CPPFLAGS	+= -DNSEC_ENTRY=$(NSEC_ENTRY)
+endif
 
 DEBUG		?= 1
 ifeq ($(DEBUG),1)
@@ -16,6 +46,15 @@ else
 PLATFORM_CFLAGS += -Os
 endif
 PLATFORM_CFLAGS += -g -g3
+
+# Trace messages above TRACE_LEVEL are compiled out, 1 (errors) to
+# 4 (flow), see include/trace.h
+ifeq ($(DEBUG),1)
+TRACE_LEVEL	?= 4
+else
+TRACE_LEVEL	?= 1
+endif
+PLATFORM_CPPFLAGS += -DTRACE_LEVEL=$(TRACE_LEVEL)
 PLATFORM_SFLAGS += -g -g3
 
 SUBDIRS += $(addprefix $(ARCH_DIR)/, kern libc sm tee)
@@ -26,22 +26,29 @@
  */
 
 #include <sm/sm.h>
+#include <sm/sm_defs.h>
 
 #include <arm32.h>
 
 #include <plat.h>
-#include <kern/misc.h>
+#include <kern/percpu.h>
+#include <kern/kern.h>
+#include <stddef.h>
 
+STATIC_ASSERT(offsetof(struct sm_nsec_ctx, svc_spsr) == SM_CTX_SVC_SPSR_OFFS);
+STATIC_ASSERT(offsetof(struct sm_sec_ctx, svc_spsr) == SM_CTX_SVC_SPSR_OFFS);
+STATIC_ASSERT(offsetof(struct sm_nsec_ctx, mon_lr) == SM_CTX_MON_LR_OFFS);
+STATIC_ASSERT(offsetof(struct sm_sec_ctx, mon_lr) == SM_CTX_MON_LR_OFFS);
+STATIC_ASSERT(offsetof(struct sm_sec_ctx, fastcall) ==
+	      SM_SEC_CTX_FASTCALL_OFFS);
 
-static struct sm_nsec_ctx sm_nsec_ctx[NUM_CPUS];
-static struct sm_sec_ctx sm_sec_ctx[NUM_CPUS];
 
 struct sm_nsec_ctx *sm_get_nsec_ctx(void)
 {
-	return &sm_nsec_ctx[get_core_pos()];
+	return &get_percpu()->sm_nsec_ctx;
 }
 
 struct sm_sec_ctx *sm_get_sec_ctx(void)
 {
-	return &sm_sec_ctx[get_core_pos()];
+	return &get_percpu()->sm_sec_ctx;
 }
@@ -25,78 +25,615 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 #include <kern/mmu.h>
+#include <kern/mutex.h>
+#include <kern/panic.h>
+#include <arm32.h>
 #include <sm/teesmc.h>
 #include <tee/entry.h>
-#include <string.h>
-#include <kprintf.h>
-#include <assert.h>
+#include <tee/fast_invoke.h>
+#include <tee/session.h>
+#include <tee/shm.h>
+#include <trace.h>
 
-static void tee_invoke(struct teesmc32_arg *arg32)
+/* TA function served by tee_fast_add() */
+#define TEE_FAST_FUNC_ADD	1
+
+/* Shared memory command rings, see struct teesmc32_ring */
+static struct {
+	volatile struct teesmc32_ring *shm;
+	volatile struct teesmc32_ring_sqe *sq;
+	volatile struct teesmc32_ring_cqe *cq;
+	uint32_t num_entries;
+	uint32_t sq_head;	/* Secure copies of the indices we own */
+	uint32_t cq_tail;
+	uint32_t num_drainers;
+} tee_ring;
+/*
+ * Taken with IRQ and FIQ masked, a holder can't be preempted or time
+ * sliced out while another thread or a fastcall spins on the lock.
+ */
+static struct mutex tee_ring_lock = MUTEX_INITIALIZER;
+
+static uint32_t tee_ring_lock_acquire(void)
 {
-	union teesmc32_param *params = TEESMC32_GET_PARAMS(arg32);
-	struct teesmc32_arg *smcarg;
-	paddr_t phsmcarg;
+	uint32_t cpsr = read_cpsr();
+
+	write_cpsr(cpsr | CPSR_F | CPSR_I);
+	mutex_lock(&tee_ring_lock);
+	return cpsr;
+}
+
+static void tee_ring_lock_release(uint32_t cpsr)
+{
+	mutex_unlock(&tee_ring_lock);
+	write_cpsr(cpsr);
+}
 
-	kprintf("Doing thread_rpc_alloc\n");
-	thread_rpc_alloc(sizeof(struct teesmc32_arg), 0, &phsmcarg, NULL);
-	kprintf("thread_rpc_alloc returned 0x%x\n", phsmcarg);
-	smcarg = (struct teesmc32_arg *)phsmcarg;
-	memset(smcarg, 0, sizeof(struct teesmc32_arg));
-	smcarg->cmd = 0x12345;
+static void tee_set_ret(struct teesmc32_arg *arg32, uint32_t ret)
+{
+	arg32->ret = ret;
+	arg32->ret_origin = TEESMC_ORIGIN_TEE;
+}
 
-	kprintf("Doing RPC cmd 0x%x (phsmcarg 0x%x)\n", smcarg->cmd, phsmcarg);
+/*
+ * Reads the number of parameters of an argument struct in normal world
+ * memory once, the value is then passed around as normal world may
+ * change it at any time. Returns false if there are too many.
+ */
+static bool tee_get_num_params(struct teesmc32_arg *arg32,
+		size_t *num_params)
+{
+	*num_params = *(volatile uint32_t *)&arg32->num_params;
+	return *num_params <= TEESMC32_MAX_NUM_PARAMS;
+}
 
-	thread_rpc_cmd(phsmcarg);
+/*
+ * Maps an argument struct supplied by normal world, the whole struct
+ * including the parameters has to be in non-secure memory. Returns
+ * NULL if it isn't, or if it has too many parameters.
+ */
+static struct teesmc32_arg *tee_map_arg(paddr_t pa, size_t *num_params)
+{
+	struct teesmc32_arg *arg32 = (struct teesmc32_arg *)
+		mmu_ns_phys_to_virt(pa, sizeof(struct teesmc32_arg));
 
-	kprintf("RPC returned 0x%x\n", smcarg->ret);
+	if (!arg32 || !tee_get_num_params(arg32, num_params) ||
+	    mmu_ns_phys_to_virt(pa, TEESMC32_GET_ARG_SIZE(*num_params)) !=
+	    (vaddr_t)arg32)
+		return NULL;
+	return arg32;
+}
 
-	kprintf("Doing thread_rpc_free\n");
-	thread_rpc_free(phsmcarg, 0);
-	kprintf("thread_rpc_free returned\n");
+static bool param_is_memref(uint8_t attr)
+{
+	switch (attr & TEESMC_ATTR_TYPE_MASK) {
+	case TEESMC_ATTR_TYPE_MEMREF_INPUT:
+	case TEESMC_ATTR_TYPE_MEMREF_OUTPUT:
+	case TEESMC_ATTR_TYPE_MEMREF_INOUT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* Request ID of the RPC done by tee_invoke() */
+#define TEE_RPC_CMD_ECHO	0x12345
+
+/*
+ * Does an RPC with num_vals value parameters, a and b of each in vals
+ * updated with what normal world returns. Two parameters fit in
+ * registers, more need a struct teesmc32_arg from thread_rpc_alloc().
+ * Returns ret of the request.
+ */
+static uint32_t tee_rpc_vals(uint32_t cmd, uint32_t *vals, size_t num_vals)
+{
+	size_t size = TEESMC32_GET_ARG_SIZE(num_vals);
+	volatile union teesmc32_param *params;
+	struct teesmc32_arg *arg32;
+	uint8_t *attrs;
+	uint32_t ret;
+	paddr_t pa;
+	size_t n;
+
+	if (num_vals <= THREAD_RPC_NUM_REG_VALS / 2)
+		return thread_rpc_cmd_regs(cmd, vals);
+
+	thread_rpc_alloc(size, 0, &pa, NULL);
+	if (!pa)
+		return TEESMC_ERROR_OUT_OF_MEMORY;
+	arg32 = (struct teesmc32_arg *)mmu_ns_phys_to_virt(pa, size);
+	if (!arg32) {
+		thread_rpc_free(pa, 0);
+		return TEESMC_ERROR_OUT_OF_MEMORY;
+	}
+
+	arg32->cmd = cmd;
+	arg32->ret = 0;
+	arg32->ret_origin = 0;
+	arg32->num_params = num_vals;
+	params = TEESMC32_GET_PARAMS(arg32);
+	attrs = (uint8_t *)(params + num_vals);
+	for (n = 0; n < num_vals; n++) {
+		params[n].value.a = vals[2 * n];
+		params[n].value.b = vals[2 * n + 1];
+		attrs[n] = TEESMC_ATTR_TYPE_VALUE_INOUT;
+	}
+
+	if (thread_rpc_cmd(pa)) {
+		ret = *(volatile uint32_t *)&arg32->ret;
+		for (n = 0; n < num_vals; n++) {
+			vals[2 * n] = params[n].value.a;
+			vals[2 * n + 1] = params[n].value.b;
+		}
+	} else {
+		ret = TEESMC_ERROR_CANCEL;
+	}
+
+	thread_rpc_free(pa, 0);
+	return ret;
+}
+
+/*
+ * Sends the parameters after the first one to normal world and returns
+ * what it updated them to, then adds value a and b of the first one.
+ */
+static void tee_invoke(struct teesmc32_arg *arg32, size_t num_params)
+{
+	volatile union teesmc32_param *params = TEESMC32_GET_PARAMS(arg32);
+	volatile uint8_t *attrs = (uint8_t *)(params + num_params);
+	uint32_t vals[2 * TEESMC32_MAX_NUM_PARAMS] = { 0 };
+	size_t num_vals = num_params > 1 ? num_params - 1 : 0;
+	uint32_t cmd = TEE_RPC_CMD_ECHO;
+	uint32_t ret;
+	size_t n;
+
+	if (num_params < 1) {
+		tee_set_ret(arg32, TEESMC_ERROR_BAD_PARAMETERS);
+		return;
+	}
+	for (n = 0; n < num_vals; n++) {
+		if (param_is_memref(attrs[n + 1])) {
+			tee_set_ret(arg32, TEESMC_ERROR_BAD_PARAMETERS);
+			return;
+		}
+		vals[2 * n] = params[n + 1].value.a;
+		vals[2 * n + 1] = params[n + 1].value.b;
+	}
 
-	assert(arg32->num_params > 0);
+	DMSG("Doing RPC cmd 0x%x\n", cmd);
+	ret = tee_rpc_vals(cmd, vals, num_vals);
+	DMSG("RPC returned 0x%x\n", ret);
+	if (thread_is_canceled()) {
+		tee_set_ret(arg32, TEESMC_ERROR_CANCEL);
+		return;
+	}
+	if (ret) {
+		tee_set_ret(arg32, ret);
+		return;
+	}
 
+	for (n = 0; n < num_vals; n++) {
+		params[n + 1].value.a = vals[2 * n];
+		params[n + 1].value.b = vals[2 * n + 1];
+	}
 	arg32->ret = 0;
 	arg32->ret_origin = 0;
 	params[0].value.a = params[0].value.a + params[0].value.b;
 }
 
-void tee_entry(struct thread_smc_args *args)
+static void tee_open_session(struct teesmc32_arg *arg32)
 {
-	struct teesmc32_arg *arg32;
+	struct tee_session *s = tee_session_open();
 
-	if (args->a0 != TEESMC32_CALL_WITH_ARG &&
-	    args->a0 != TEESMC32_FASTCALL_WITH_ARG) {
-		kprintf("Unknown SMC 0x%x\n", args->a0);
-		kprintf("Expected 0x%x or 0x%x\n",
-			TEESMC32_CALL_WITH_ARG, TEESMC32_FASTCALL_WITH_ARG);
-		args->a0 = -1;
+	if (!s) {
+		tee_set_ret(arg32, TEESMC_ERROR_OUT_OF_MEMORY);
 		return;
 	}
+	arg32->session = s->handle;
+	tee_set_ret(arg32, 0);
+}
+
+static void tee_close_session(struct teesmc32_arg *arg32)
+{
+	if (!tee_session_close(arg32->session))
+		tee_set_ret(arg32, TEESMC_ERROR_ITEM_NOT_FOUND);
+	else
+		tee_set_ret(arg32, 0);
+}
+
+/* Releases the shared memory recorded by tee_get_memrefs() */
+static void tee_put_memrefs(const paddr_t *bufs, size_t num_params)
+{
+	size_t n;
+
+	for (n = 0; n < num_params; n++)
+		if (bufs[n])
+			tee_shm_put(bufs[n]);
+}
 
-	arg32 = (struct teesmc32_arg *)args->a1;
+/*
+ * Checks that the memrefs are inside registered shared memory, they're
+ * then accessed in place until tee_put_memrefs() is called. Each
+ * attribute and memref is read once from normal world memory, the
+ * buffers gotten are recorded in bufs, 0 for other parameters, so the
+ * put doesn't depend on what normal world has changed meanwhile.
+ */
+static bool tee_get_memrefs(struct teesmc32_arg *arg32, size_t num_params,
+		paddr_t bufs[TEESMC32_MAX_NUM_PARAMS])
+{
+	volatile union teesmc32_param *params = TEESMC32_GET_PARAMS(arg32);
+	volatile uint8_t *attrs = (uint8_t *)(params + num_params);
+	uint32_t cache_attr;
+	uint8_t attr;
+	paddr_t buf;
+	size_t n;
 
+	for (n = 0; n < num_params; n++) {
+		bufs[n] = 0;
+		attr = attrs[n];
+		if (!param_is_memref(attr))
+			continue;
+		cache_attr = (attr >> TEESMC_ATTR_CACHE_SHIFT) &
+			     TEESMC_ATTR_CACHE_MASK;
+		buf = params[n].memref.buf_ptr;
+		if (!tee_shm_get(buf, params[n].memref.size, cache_attr)) {
+			tee_put_memrefs(bufs, n);
+			return false;
+		}
+		bufs[n] = buf;
+	}
+	return true;
+}
+
+static void tee_invoke_session(struct teesmc32_arg *arg32,
+		size_t num_params)
+{
+	/* Read once, normal world may change it at any time */
+	uint32_t session = *(volatile uint32_t *)&arg32->session;
+	struct tee_session *s = tee_session_get(session);
+	paddr_t bufs[TEESMC32_MAX_NUM_PARAMS];
+
+	if (!s) {
+		tee_set_ret(arg32, TEESMC_ERROR_ITEM_NOT_FOUND);
+		return;
+	}
+	if (!tee_get_memrefs(arg32, num_params, bufs)) {
+		tee_set_ret(arg32, TEESMC_ERROR_BAD_PARAMETERS);
+	} else {
+		/* The session handle identifies the call to TEESMC_CMD_CANCEL */
+		thread_set_cancel_id(session);
+		tee_invoke(arg32, num_params);
+		thread_set_cancel_id(THREAD_CANCEL_ID_NONE);
+		tee_put_memrefs(bufs, num_params);
+	}
+	tee_session_put(s);
+}
+
+/* Lock-free, also used from fastcalls */
+static void tee_cancel(struct teesmc32_arg *arg32)
+{
+	if (thread_cancel(arg32->session))
+		tee_set_ret(arg32, 0);
+	else
+		tee_set_ret(arg32, TEESMC_ERROR_ITEM_NOT_FOUND);
+}
+
+static uint32_t tee_entry_arg(struct teesmc32_arg *arg32, size_t num_params)
+{
 	switch (arg32->cmd) {
 	case TEESMC_CMD_OPEN_SESSION:
-		kprintf("TEESMC_CMD_OPEN_SESSION\n");
-		args->a0 = TEESMC_RETURN_OK;
-		break;
+		FMSG("TEESMC_CMD_OPEN_SESSION\n");
+		tee_open_session(arg32);
+		return TEESMC_RETURN_OK;
 	case TEESMC_CMD_CLOSE_SESSION:
-		kprintf("TEESMC_CMD_CLOSE_SESSION\n");
-		args->a0 = TEESMC_RETURN_OK;
-		break;
+		FMSG("TEESMC_CMD_CLOSE_SESSION\n");
+		tee_close_session(arg32);
+		return TEESMC_RETURN_OK;
 	case TEESMC_CMD_INVOKE_COMMAND:
-		kprintf("TEESMC_CMD_INVOKE_COMMAND\n");
-		tee_invoke(arg32);
-		args->a0 = TEESMC_RETURN_OK;
-		break;
+		FMSG("TEESMC_CMD_INVOKE_COMMAND\n");
+		tee_invoke_session(arg32, num_params);
+		return TEESMC_RETURN_OK;
 	case TEESMC_CMD_CANCEL:
-		kprintf("TEESMC_CMD_CANCEL\n");
-		args->a0 = TEESMC_RETURN_OK;
-		break;
+		FMSG("TEESMC_CMD_CANCEL\n");
+		tee_cancel(arg32);
+		return TEESMC_RETURN_OK;
 	default:
-		kprintf("Unknown cmd 0x%x\n", arg32->cmd);
-		args->a0 = TEESMC_RETURN_UNKNOWN_FUNCTION;
-		break;;
+		EMSG("Unknown cmd 0x%x\n", arg32->cmd);
+		return TEESMC_RETURN_UNKNOWN_FUNCTION;
 	}
 }
+
+/*
+ * Handles TEESMC32_FASTCALL_WITH_ARG on the temporary stack, no RPCs and
+ * no spinning on locks a suspended thread may hold.
+ */
+static uint32_t tee_entry_fast(struct teesmc32_arg *arg32, size_t num_params)
+{
+	uint8_t *attrs = (uint8_t *)(TEESMC32_GET_PARAMS(arg32) + num_params);
+	uint32_t cmd = *(volatile uint32_t *)&arg32->cmd;
+	tee_fast_invoke_func_t func;
+	struct tee_session *s;
+	size_t n;
+
+	/* Needs no free thread, so it works when all are held by stuck calls */
+	if (cmd == TEESMC_CMD_CANCEL) {
+		FMSG("TEESMC_CMD_CANCEL\n");
+		tee_cancel(arg32);
+		return TEESMC_RETURN_OK;
+	}
+	if (cmd != TEESMC_CMD_INVOKE_COMMAND)
+		goto not_supported;
+	func = tee_fast_invoke_find(arg32->ta_func);
+	if (!func)
+		goto not_supported;
+	for (n = 0; n < num_params; n++)
+		if (param_is_memref(attrs[n]))
+			goto not_supported;
+
+	/* Lock-free, safe in fastcall context */
+	s = tee_session_get(arg32->session);
+	if (!s) {
+		tee_set_ret(arg32, TEESMC_ERROR_ITEM_NOT_FOUND);
+		return TEESMC_RETURN_OK;
+	}
+	tee_set_ret(arg32, func(s->ctx, arg32, num_params));
+	tee_session_put(s);
+	return TEESMC_RETURN_OK;
+
+not_supported:
+	tee_set_ret(arg32, TEESMC_ERROR_NOT_SUPPORTED);
+	return TEESMC_RETURN_OK;
+}
+
+/*
+ * Processes the entries of a batch back to back, the whole batch is
+ * accounted as THREAD_STATS_CMD_OTHER.
+ */
+static uint32_t tee_entry_batch(paddr_t pa, size_t num_args, size_t size)
+{
+	uint8_t *buf = (uint8_t *)mmu_ns_phys_to_virt(pa, size);
+	size_t offs = 0;
+	size_t n;
+
+	if (!buf)
+		return TEESMC_RETURN_EBADCMD;
+
+	thread_set_stats_cmd(THREAD_STATS_CMD_OTHER);
+
+	for (n = 0; n < num_args; n++) {
+		struct teesmc32_arg *arg32;
+		size_t num_params;
+		size_t arg_size;
+
+		if (size - offs < sizeof(struct teesmc32_arg))
+			return TEESMC_RETURN_EBADCMD;
+		arg32 = (struct teesmc32_arg *)(buf + offs);
+		/* Bounded, so the size below can't overflow */
+		if (!tee_get_num_params(arg32, &num_params))
+			return TEESMC_RETURN_EBADCMD;
+		arg_size = TEESMC32_GET_BATCH_ARG_SIZE(num_params);
+		if (size - offs < arg_size)
+			return TEESMC_RETURN_EBADCMD;
+
+		if (tee_entry_arg(arg32, num_params) != TEESMC_RETURN_OK) {
+			arg32->ret = TEESMC_RETURN_UNKNOWN_FUNCTION;
+			arg32->ret_origin = TEESMC_ORIGIN_COMMS;
+		}
+		offs += arg_size;
+	}
+
+	return TEESMC_RETURN_OK;
+}
+
+static uint32_t tee_ring_register(paddr_t pa, size_t num_entries)
+{
+	volatile struct teesmc32_ring *shm;
+	uint32_t cpsr;
+
+	if ((pa & 3) || !num_entries ||
+	    num_entries > TEESMC32_RING_MAX_ENTRIES ||
+	    (num_entries & (num_entries - 1)))
+		return TEESMC_RETURN_EBADCMD;
+	/* Both rings have to be in non-secure memory too */
+	shm = (struct teesmc32_ring *)mmu_ns_phys_to_virt(pa,
+			TEESMC32_RING_GET_SIZE(num_entries));
+	if (!shm)
+		return TEESMC_RETURN_EBADCMD;
+
+	cpsr = tee_ring_lock_acquire();
+	if (tee_ring.num_drainers) {
+		tee_ring_lock_release(cpsr);
+		return TEESMC_RETURN_EBUSY;
+	}
+
+	tee_ring.shm = shm;
+	tee_ring.sq = TEESMC32_RING_GET_SQ(shm);
+	tee_ring.cq = TEESMC32_RING_GET_CQ(shm, num_entries);
+	tee_ring.num_entries = num_entries;
+	tee_ring.sq_head = 0;
+	tee_ring.cq_tail = 0;
+	shm->sq_head = 0;
+	shm->cq_tail = 0;
+	shm->draining = 0;
+
+	tee_ring_lock_release(cpsr);
+	return TEESMC_RETURN_OK;
+}
+
+/*
+ * Returns true if there's a submission and room for its completion,
+ * called with tee_ring_lock held.
+ */
+static bool tee_ring_can_pop(void)
+{
+	return tee_ring.shm->sq_tail != tee_ring.sq_head &&
+	       tee_ring.sq_head - tee_ring.shm->cq_head < tee_ring.num_entries;
+}
+
+/*
+ * Consumes the next submission, returns false if the submission ring is
+ * empty or there's no room left for another completion.
+ */
+static bool tee_ring_pop(struct teesmc32_ring_sqe *sqe)
+{
+	uint32_t mask = tee_ring.num_entries - 1;
+	uint32_t cpsr = tee_ring_lock_acquire();
+	bool ret = false;
+
+	if (tee_ring_can_pop()) {
+		dmb();	/* Read sq_tail before the entry it covers */
+		sqe->arg = tee_ring.sq[tee_ring.sq_head & mask].arg;
+		sqe->cookie = tee_ring.sq[tee_ring.sq_head & mask].cookie;
+		tee_ring.sq_head++;
+		tee_ring.shm->sq_head = tee_ring.sq_head;
+		ret = true;
+	}
+	tee_ring_lock_release(cpsr);
+
+	return ret;
+}
+
+/* Room for the completion was reserved when the submission was popped */
+static void tee_ring_push(uint32_t cookie, uint32_t res)
+{
+	uint32_t mask = tee_ring.num_entries - 1;
+	uint32_t cpsr = tee_ring_lock_acquire();
+
+	tee_ring.cq[tee_ring.cq_tail & mask].cookie = cookie;
+	tee_ring.cq[tee_ring.cq_tail & mask].ret = res;
+	dmb();	/* Write the entry before the cq_tail covering it */
+	tee_ring.cq_tail++;
+	tee_ring.shm->cq_tail = tee_ring.cq_tail;
+	tee_ring_lock_release(cpsr);
+}
+
+/*
+ * Stops draining unless submissions were added after the last pop,
+ * returns false if the caller has to keep draining.
+ */
+static bool tee_ring_stop_drain(void)
+{
+	uint32_t cpsr = tee_ring_lock_acquire();
+
+	if (tee_ring.num_drainers == 1) {
+		/*
+		 * Normal world skips the doorbell while draining is set,
+		 * clear it and check again for a submission added before
+		 * normal world could see the cleared flag.
+		 */
+		tee_ring.shm->draining = 0;
+		dmb();
+		if (tee_ring_can_pop()) {
+			tee_ring.shm->draining = 1;
+			tee_ring_lock_release(cpsr);
+			return false;
+		}
+	}
+	tee_ring.num_drainers--;
+	tee_ring_lock_release(cpsr);
+	return true;
+}
+
+static uint32_t tee_ring_drain(void)
+{
+	struct teesmc32_ring_sqe sqe;
+	uint32_t cpsr;
+	uint32_t res;
+
+	cpsr = tee_ring_lock_acquire();
+	if (!tee_ring.shm) {
+		tee_ring_lock_release(cpsr);
+		return TEESMC_RETURN_EBADCMD;
+	}
+	tee_ring.num_drainers++;
+	tee_ring.shm->draining = 1;
+	tee_ring_lock_release(cpsr);
+
+	thread_set_stats_cmd(THREAD_STATS_CMD_OTHER);
+
+	do {
+		while (tee_ring_pop(&sqe)) {
+			size_t num_params;
+			struct teesmc32_arg *arg32 =
+				tee_map_arg(sqe.arg, &num_params);
+
+			if (!arg32)
+				res = TEESMC_RETURN_EBADCMD;
+			else if (tee_entry_arg(arg32, num_params) !=
+				 TEESMC_RETURN_OK)
+				res = TEESMC_RETURN_UNKNOWN_FUNCTION;
+			else
+				res = TEESMC_RETURN_OK;
+			tee_ring_push(sqe.cookie, res);
+		}
+	} while (!tee_ring_stop_drain());
+
+	return TEESMC_RETURN_OK;
+}
+
+void tee_entry(struct thread_smc_args *args)
+{
+	struct teesmc32_arg *arg32;
+	size_t num_params;
+
+	switch (args->a0) {
+	case TEESMC32_CALL_WITH_ARG_BATCH:
+		args->a0 = tee_entry_batch(args->a1, args->a2, args->a3);
+		return;
+	case TEESMC32_FASTCALL_REGISTER_RING:
+		args->a0 = tee_ring_register(args->a1, args->a2);
+		return;
+	case TEESMC32_CALL_RING_DOORBELL:
+		args->a0 = tee_ring_drain();
+		return;
+	case TEESMC32_FASTCALL_REGISTER_SHM:
+		args->a0 = tee_shm_register(args->a1, args->a2, args->a3);
+		return;
+	case TEESMC32_FASTCALL_UNREGISTER_SHM:
+		args->a0 = tee_shm_unregister(args->a1);
+		return;
+	default:
+		break;
+	}
+
+	if (args->a0 != TEESMC32_CALL_WITH_ARG &&
+	    args->a0 != TEESMC32_FASTCALL_WITH_ARG) {
+		EMSG("Unknown SMC 0x%x\n", args->a0);
+		EMSG("Expected 0x%x or 0x%x\n",
+			TEESMC32_CALL_WITH_ARG, TEESMC32_FASTCALL_WITH_ARG);
+		args->a0 = -1;
+		return;
+	}
+
+	arg32 = tee_map_arg(args->a1, &num_params);
+	if (!arg32) {
+		EMSG("Bad arg 0x%x\n", args->a1);
+		args->a0 = TEESMC_RETURN_EBADCMD;
+		return;
+	}
+	if (args->a0 == TEESMC32_FASTCALL_WITH_ARG) {
+		args->a0 = tee_entry_fast(arg32, num_params);
+		return;
+	}
+	thread_set_stats_cmd(arg32->cmd);
+	args->a0 = tee_entry_arg(arg32, num_params);
+}
+
+/* Same as tee_invoke() without the RPC */
+static uint32_t tee_fast_add(void *sess_ctx,
+			     struct teesmc32_arg *arg32, size_t num_params)
+{
+	union teesmc32_param *params = TEESMC32_GET_PARAMS(arg32);
+
+	if (num_params < 1)
+		return TEESMC_ERROR_BAD_PARAMETERS;
+	params[0].value.a = params[0].value.a + params[0].value.b;
+	return 0;
+}
+
+void tee_entry_init(void)
+{
+	tee_session_init();
+	if (!tee_fast_invoke_register(TEE_FAST_FUNC_ADD, tee_fast_add))
+		panic();
+}
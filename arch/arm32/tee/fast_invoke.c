@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2014, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <tee/fast_invoke.h>
+#include <stddef.h>
+
+static struct {
+	uint32_t ta_func;
+	tee_fast_invoke_func_t func;
+} fast_funcs[TEE_FAST_INVOKE_MAX_FUNCS];
+static size_t num_fast_funcs;
+
+bool tee_fast_invoke_register(uint32_t ta_func, tee_fast_invoke_func_t func)
+{
+	if (num_fast_funcs >= TEE_FAST_INVOKE_MAX_FUNCS ||
+	    tee_fast_invoke_find(ta_func))
+		return false;
+
+	fast_funcs[num_fast_funcs].ta_func = ta_func;
+	fast_funcs[num_fast_funcs].func = func;
+	num_fast_funcs++;
+	return true;
+}
+
+tee_fast_invoke_func_t tee_fast_invoke_find(uint32_t ta_func)
+{
+	size_t n;
+
+	/* Few entries, a linear search is as fast as anything else */
+	for (n = 0; n < num_fast_funcs; n++)
+		if (fast_funcs[n].ta_func == ta_func)
+			return fast_funcs[n].func;
+	return NULL;
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2014, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <tee/session.h>
+#include <arm32.h>
+#include <kern/atomic.h>
+#include <kern/kern.h>
+#include <stddef.h>
+#include <assert.h>
+
+STATIC_ASSERT(TEE_NUM_SESSIONS <= TEE_SESSION_IDX_MASK);
+
+#define SESSION_NONE	TEE_NUM_SESSIONS /* End of free list */
+
+static struct tee_session sessions[TEE_NUM_SESSIONS];
+/*
+ * Head of the free list, a lock-free stack updated with atomic_cas32().
+ * The index of the first free session is in the lower bits and a tag
+ * bumped on each update is in the upper bits, so a pop racing with a
+ * pop and push of the same session fails its CAS. The free path is
+ * reached from fastcalls with interrupts masked so it can't take a lock.
+ */
+static uint32_t session_free_head;
+
+static uint32_t free_head_next(uint32_t old_head, uint32_t idx)
+{
+	return (((old_head >> TEE_SESSION_IDX_BITS) + 1) <<
+		TEE_SESSION_IDX_BITS) | idx;
+}
+
+void tee_session_init(void)
+{
+	size_t n;
+
+	for (n = 0; n < TEE_NUM_SESSIONS; n++)
+		sessions[n].next_free = n + 1;
+	session_free_head = free_head_next(0, 0);
+}
+
+struct tee_session *tee_session_open(void)
+{
+	struct tee_session *s;
+	uint32_t head;
+	uint32_t idx;
+
+	do {
+		head = session_free_head;
+		idx = head & TEE_SESSION_IDX_MASK;
+		if (idx == SESSION_NONE)
+			return NULL;
+	} while (!atomic_cas32(&session_free_head, head,
+			       free_head_next(head, sessions[idx].next_free)));
+
+	s = &sessions[idx];
+	s->generation++;
+	if (!(s->generation << TEE_SESSION_IDX_BITS))
+		s->generation = 1;	/* Keeps the handle non-zero */
+	s->ctx = NULL;
+	s->refcount = 1;
+	/* The handle is published last, it's checked by tee_session_get() */
+	dmb();
+	s->handle = (s->generation << TEE_SESSION_IDX_BITS) | idx;
+
+	return s;
+}
+
+bool tee_session_close(uint32_t handle)
+{
+	uint32_t idx = handle & TEE_SESSION_IDX_MASK;
+
+	if (!handle || idx >= TEE_NUM_SESSIONS ||
+	    !atomic_cas32(&sessions[idx].handle, handle, 0))
+		return false;
+
+	tee_session_put(&sessions[idx]);
+	return true;
+}
+
+struct tee_session *tee_session_get(uint32_t handle)
+{
+	uint32_t idx = handle & TEE_SESSION_IDX_MASK;
+	struct tee_session *s;
+	uint32_t rc;
+
+	if (!handle || idx >= TEE_NUM_SESSIONS)
+		return NULL;
+	s = &sessions[idx];
+
+	do {
+		rc = s->refcount;
+		if (!rc || s->handle != handle)
+			return NULL;
+	} while (!atomic_cas32(&s->refcount, rc, rc + 1));
+
+	/* The session may have been closed and reopened meanwhile */
+	if (s->handle != handle) {
+		tee_session_put(s);
+		return NULL;
+	}
+
+	return s;
+}
+
+void tee_session_put(struct tee_session *s)
+{
+	uint32_t head;
+	uint32_t rc;
+
+	do {
+		rc = s->refcount;
+		assert(rc);
+	} while (!atomic_cas32(&s->refcount, rc, rc - 1));
+
+	if (rc != 1)
+		return;
+
+	do {
+		head = session_free_head;
+		s->next_free = head & TEE_SESSION_IDX_MASK;
+	} while (!atomic_cas32(&session_free_head, head,
+			       free_head_next(head, s - sessions)));
+}
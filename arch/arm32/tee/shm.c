@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2014, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Registered shared memory. The ranges are kept sorted on address in
+ * an array so a lookup is a binary search. Each range is mapped once
+ * at registration with the cache policy normal world uses for it, so
+ * memref parameters are accessed in place without any per call
+ * mapping.
+ */
+
+#include <tee/shm.h>
+#include <kern/cache.h>
+#include <kern/kern.h>
+#include <kern/mmu.h>
+#include <kern/mutex.h>
+#include <arm32.h>
+#include <sm/teesmc.h>
+#include <plat.h>
+#include <assert.h>
+
+struct tee_shm_range {
+	paddr_t pa;
+	size_t size;
+	uint32_t cache_attr;
+	uint32_t num_users;
+};
+
+static struct tee_shm_range tee_shm_ranges[TEE_SHM_MAX_RANGES];
+static size_t tee_shm_num_ranges;
+/*
+ * Taken with IRQ and FIQ masked by threads, a holder can't be preempted
+ * or time sliced out while another thread spins on the lock or a
+ * fastcall fails its trylock.
+ */
+static struct mutex tee_shm_lock = MUTEX_INITIALIZER;
+
+#define SECTION_SIZE		0x00100000
+#define SECTION_MASK		(SECTION_SIZE - 1)
+
+static uint32_t tee_shm_lock_acquire(void)
+{
+	uint32_t cpsr = read_cpsr();
+
+	write_cpsr(cpsr | CPSR_F | CPSR_I);
+	mutex_lock(&tee_shm_lock);
+	return cpsr;
+}
+
+static void tee_shm_lock_release(uint32_t cpsr)
+{
+	mutex_unlock(&tee_shm_lock);
+	write_cpsr(cpsr);
+}
+
+static uint32_t cache_attr_to_mmu(uint32_t attr)
+{
+	switch (attr & 0x3) {
+	case TEESMC_ATTR_CACHE_I_WRITE_THR:
+		return MMU_CACHE_WT;
+	case TEESMC_ATTR_CACHE_I_WRITE_BACK:
+		return MMU_CACHE_WBWA;
+	default:
+		return MMU_CACHE_NONCACHE;
+	}
+}
+
+/* Returns the index of the first range ending above pa */
+static size_t find_range(paddr_t pa)
+{
+	size_t lo = 0;
+	size_t hi = tee_shm_num_ranges;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		struct tee_shm_range *r = &tee_shm_ranges[mid];
+
+		if (pa - r->pa < r->size || pa < r->pa)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return lo;
+}
+
+static bool shares_section(const struct tee_shm_range *r, paddr_t pa,
+		size_t size)
+{
+	paddr_t r_first = r->pa & ~SECTION_MASK;
+	paddr_t r_last = (r->pa + r->size - 1) & ~SECTION_MASK;
+
+	return (pa & ~SECTION_MASK) <= r_last &&
+	       ((pa + size - 1) & ~SECTION_MASK) >= r_first;
+}
+
+uint32_t tee_shm_register(paddr_t pa, size_t size, uint32_t cache_attr)
+{
+	uint32_t res = TEESMC_RETURN_OK;
+	size_t idx;
+	size_t n;
+
+	cache_attr &= TEESMC_ATTR_CACHE_MASK;
+	/* Bounds the clean below as interrupts are masked meanwhile */
+	if (!size || size > TEESMC_SHM_MAX_SIZE || pa < DDR0_BASE ||
+	    size > DDR0_SIZE || pa - DDR0_BASE > DDR0_SIZE - size)
+		return TEESMC_RETURN_EBADCMD;
+
+	/* Called from a fastcall, can't spin on the lock */
+	if (!mutex_trylock(&tee_shm_lock))
+		return TEESMC_RETURN_EBUSY;
+
+	idx = find_range(pa);
+	if (tee_shm_num_ranges == TEE_SHM_MAX_RANGES ||
+	    (idx < tee_shm_num_ranges &&
+	     tee_shm_ranges[idx].pa < pa + size)) {
+		res = TEESMC_RETURN_EBADCMD;	/* Full or overlapping */
+		goto out;
+	}
+
+	/* Ranges sharing a section must use the same cache policy */
+	for (n = 0; n < tee_shm_num_ranges; n++) {
+		if (shares_section(tee_shm_ranges + n, pa, size) &&
+		    tee_shm_ranges[n].cache_attr != cache_attr) {
+			res = TEESMC_RETURN_EBADCMD;
+			goto out;
+		}
+	}
+
+	/*
+	 * The sections covering the range are remapped, either from the
+	 * default non-secure mapping, which is device memory and never
+	 * cached, or from a mapping with the same attributes when shared
+	 * with another range. No lines outside the range can be left with
+	 * old attributes, only the range itself is cleaned.
+	 */
+	cache_dcache_clean_inv_range(pa, size);
+	mmu_map_ns_mem(pa, size, cache_attr_to_mmu(cache_attr),
+		       cache_attr_to_mmu(cache_attr >> 2));
+
+	for (n = tee_shm_num_ranges; n > idx; n--)
+		tee_shm_ranges[n] = tee_shm_ranges[n - 1];
+	tee_shm_ranges[idx].pa = pa;
+	tee_shm_ranges[idx].size = size;
+	tee_shm_ranges[idx].cache_attr = cache_attr;
+	tee_shm_ranges[idx].num_users = 0;
+	tee_shm_num_ranges++;
+out:
+	mutex_unlock(&tee_shm_lock);
+	return res;
+}
+
+uint32_t tee_shm_unregister(paddr_t pa)
+{
+	struct tee_shm_range r;
+	paddr_t a;
+	size_t idx;
+	size_t n;
+
+	if (!mutex_trylock(&tee_shm_lock))
+		return TEESMC_RETURN_EBUSY;
+
+	idx = find_range(pa);
+	if (idx == tee_shm_num_ranges || tee_shm_ranges[idx].pa != pa) {
+		mutex_unlock(&tee_shm_lock);
+		return TEESMC_RETURN_EBADCMD;
+	}
+	if (tee_shm_ranges[idx].num_users) {
+		mutex_unlock(&tee_shm_lock);
+		return TEESMC_RETURN_EBUSY;
+	}
+
+	r = tee_shm_ranges[idx];
+	tee_shm_num_ranges--;
+	for (n = idx; n < tee_shm_num_ranges; n++)
+		tee_shm_ranges[n] = tee_shm_ranges[n + 1];
+
+	/*
+	 * Sections no longer used by any range gets the default mapping of
+	 * normal world memory back, the cache has to be cleaned first.
+	 */
+	cache_dcache_clean_inv_range(r.pa, r.size);
+	for (a = r.pa & ~SECTION_MASK; a < r.pa + r.size; a += SECTION_SIZE) {
+		for (n = 0; n < tee_shm_num_ranges; n++)
+			if (shares_section(tee_shm_ranges + n, a, SECTION_SIZE))
+				break;
+		if (n == tee_shm_num_ranges)
+			mmu_map_rwmem(a, SECTION_SIZE, true);
+	}
+
+	mutex_unlock(&tee_shm_lock);
+	return TEESMC_RETURN_OK;
+}
+
+vaddr_t tee_shm_get(paddr_t pa, size_t size, uint32_t cache_attr)
+{
+	struct tee_shm_range *r;
+	uint32_t cpsr;
+	vaddr_t va = 0;
+	size_t idx;
+
+	cpsr = tee_shm_lock_acquire();
+	idx = find_range(pa);
+	if (idx < tee_shm_num_ranges) {
+		r = &tee_shm_ranges[idx];
+		if (pa >= r->pa && size <= r->size - (pa - r->pa) &&
+		    r->cache_attr == (cache_attr & TEESMC_ATTR_CACHE_MASK)) {
+			va = mmu_ns_phys_to_virt(pa, size);
+			if (va)
+				r->num_users++;
+		}
+	}
+	tee_shm_lock_release(cpsr);
+
+	return va;
+}
+
+void tee_shm_put(paddr_t pa)
+{
+	uint32_t cpsr = tee_shm_lock_acquire();
+	size_t idx;
+
+	idx = find_range(pa);
+	assert(idx < tee_shm_num_ranges && tee_shm_ranges[idx].num_users);
+	tee_shm_ranges[idx].num_users--;
+	tee_shm_lock_release(cpsr);
+}
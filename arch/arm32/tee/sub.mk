@@ -1 +1,4 @@
 srcs-y += entry.c
+srcs-y += session.c
+srcs-y += shm.c
+srcs-y += fast_invoke.c
@@ -0,0 +1,51 @@
+# Normal world stub measuring the SMC round trips of kern.elf, see
+# bench/main.c. Build with "make bench" and run headless with
+# "make run-bench", the results are printed on stdout. Build and run
+# with NUM_CPUS=4 for the stdcall throughput on up to 4 CPUs.
+
+bench-out-dir	:= $(out-dir)bench/
+BENCH_LINK_SCRIPT = bench/nw_stub.ld
+
+BENCH_OBJS	:= $(bench-out-dir)entry.o $(bench-out-dir)main.o
+# Console and string functions are shared with the Trusted OS build
+BENCH_OBJS	+= $(addprefix $(out-dir), drivers/uart.o kern/kprintf.o \
+			kern/kvprintf.o libc/memset.o libc/strlen.o \
+			libc/stack_check.o arch/arm32/libc/eabi.o)
+
+QEMU		?= qemu-system-arm
+QEMU_FLAGS	 = -machine vexpress-a15,secure=on -cpu cortex-a15 -m 1024
+QEMU_FLAGS	+= -display none -serial stdio
+QEMU_FLAGS	+= -serial file:$(bench-out-dir)secure.log
+QEMU_FLAGS	+= -semihosting-config enable=on,target=native
+QEMU_FLAGS	+= -device loader,file=$(bench-out-dir)nw_stub.elf
+QEMU_FLAGS	+= -device loader,file=$(out-dir)kern.elf,cpu-num=0
+# Secondary CPUs start in kern.elf as well
+QEMU_FLAGS	+= -smp $(NUM_CPUS)
+QEMU_FLAGS	+= $(foreach n,$(wordlist 2,$(NUM_CPUS),0 1 2 3), \
+			-device loader,file=$(out-dir)kern.elf,cpu-num=$(n))
+
+CLEANFILES += $(bench-out-dir)entry.o $(bench-out-dir)main.o
+CLEANFILES += $(bench-out-dir)nw_stub.elf $(bench-out-dir)secure.log
+
+$(bench-out-dir)%.o: bench/%.c
+	@mkdir -p $(dir $@)
+	@echo CC $<
+	$(Q)$(CC) $(CPPFLAGS) $(CFLAGS) -c $< -o $@
+
+$(bench-out-dir)%.o: bench/%.S
+	@mkdir -p $(dir $@)
+	@echo CC $<
+	$(Q)$(CC) -DASM=1 $(CPPFLAGS) $(SFLAGS) -c $< -o $@
+
+$(bench-out-dir)nw_stub.elf: $(BENCH_OBJS) $(BENCH_LINK_SCRIPT)
+	@echo LD $@
+	${Q}$(LD) -e _start -T $(BENCH_LINK_SCRIPT) \
+		--defsym=BENCH_NSEC_ENTRY=$(NSEC_ENTRY) \
+		$(BENCH_OBJS) $(LIBGCC) -o $@
+
+.PHONY: bench
+bench: $(out-dir)kern.elf $(bench-out-dir)nw_stub.elf
+
+.PHONY: run-bench
+run-bench: bench
+	${Q}$(QEMU) $(QEMU_FLAGS)
@@ -0,0 +1,414 @@
+/*
+ * Copyright (c) 2014, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Normal world stub measuring the round trip of the SMC paths of the
+ * Trusted OS with the PMU cycle counter. The results are printed on
+ * UART0, the Trusted OS keeps UART1 which is only used here to raise
+ * FIQs.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <arm32.h>
+#include <plat.h>
+#include <sm/teesmc.h>
+#include <drivers/uart.h>
+#include <io.h>
+#include <kprintf.h>
+
+#define BENCH_LOOPS		1000
+
+/* TEE_FAST_FUNC_ADD in tee/entry.c */
+#define BENCH_FAST_FUNC_ADD	1
+
+/*
+ * The non-secure physical timer raises the forwarded IRQ, the GIC is
+ * accessed with the non-secure view of the registers.
+ */
+#define BENCH_IT_NS_PHY_TIMER	30
+#define BENCH_GICC_CTLR		0x000
+#define BENCH_GICC_PMR		0x004
+#define BENCH_GICD_ISENABLER(n)	(0x100 + (n) * 4)
+#define BENCH_GICD_IPRIORITYR	0x400
+
+/*
+ * The forwarded FIQ is the receive interrupt of the secure console,
+ * raised by looping back a byte sent on it.
+ */
+#define BENCH_UART_DR		0x00
+#define BENCH_UART_FR		0x18
+#define BENCH_UART_CR		0x30
+#define BENCH_UART_FR_RXFE	(1 << 4)
+#define BENCH_UART_FR_BUSY	(1 << 3)
+#define BENCH_UART_CR_LPE	(1 << 7)
+
+struct bench_stats {
+	const char *name;
+	uint64_t cycles;
+	uint32_t min_cycles;
+	uint32_t max_cycles;
+	uint32_t num_calls;
+	uint32_t num_rpcs;
+	uint32_t num_irqs;
+};
+
+/*
+ * Length of each SMP run, every online CPU does stdcalls back to back
+ * meanwhile.
+ */
+#define BENCH_SMP_CYCLES	(100 * 1000 * 1000)
+/* Time given to the secondary CPUs to reach normal world */
+#define BENCH_SMP_BOOT_CYCLES	(1000 * 1000 * 1000)
+
+void bench_main(void);
+void bench_secondary(size_t pos);
+void bench_smc(uint32_t regs[8]);
+
+/* Argument memory handed out by TEESMC_RETURN_RPC_ALLOC */
+static uint32_t bench_rpc_arg[256 / sizeof(uint32_t)];
+
+/* Parameters after the first one are sent back by the RPC of the invoke */
+#define BENCH_MAX_PARAMS	4
+#define BENCH_ARG_WORDS	\
+	(TEESMC32_GET_ARG_SIZE(BENCH_MAX_PARAMS) / sizeof(uint32_t) + 1)
+static uint32_t bench_arg[BENCH_ARG_WORDS];
+
+/* Donated with TEESMC32_FASTCALL_REGISTER_RPC_POOL */
+#define BENCH_RPC_POOL_SIZE	4096
+static uint32_t bench_rpc_pool[BENCH_RPC_POOL_SIZE / sizeof(uint32_t)]
+	__attribute__((aligned(64)));
+
+/*
+ * State shared with the secondary CPUs. Normal world runs with the MMU
+ * off so the accesses are strongly ordered and need no barriers. A run
+ * is started by bumping bench_smp_gen, a CPU is done with it once its
+ * entry in bench_smp_done has the new value.
+ */
+static uint32_t bench_smp_arg[NUM_CPUS][BENCH_ARG_WORDS];
+static volatile uint32_t bench_smp_online[NUM_CPUS];
+static volatile uint32_t bench_smp_calls[NUM_CPUS];
+static volatile uint32_t bench_smp_done[NUM_CPUS];
+static volatile uint32_t bench_smp_gen;
+static volatile uint32_t bench_smp_num_cpus;
+static volatile uint32_t bench_smp_stop;
+
+/*
+ * Issues a call and serves the RPCs until the call is completed,
+ * busy and waiting calls are reissued.
+ */
+static uint32_t bench_call(struct bench_stats *s, uint32_t a0, uint32_t a1,
+		uint32_t a2, uint32_t a3)
+{
+	uint32_t regs[8] = { a0, a1, a2, a3 };
+	struct teesmc32_arg *rpc_arg;
+
+	while (true) {
+		bench_smc(regs);
+
+		if (regs[0] == TEESMC_RETURN_EBUSY ||
+		    regs[0] == TEESMC_RETURN_EWAIT) {
+			regs[0] = a0;
+			regs[1] = a1;
+			regs[2] = a2;
+			regs[3] = a3;
+			continue;
+		}
+		if (!TEESMC_RETURN_IS_RPC(regs[0]))
+			return regs[0];
+
+		s->num_rpcs++;
+		switch (regs[0]) {
+		case TEESMC_RETURN_RPC_ALLOC:
+			regs[1] = regs[1] <= sizeof(bench_rpc_arg) ?
+				  (uint32_t)bench_rpc_arg : 0;
+			regs[2] = 0;
+			break;
+		case TEESMC_RETURN_RPC_CMD:
+			rpc_arg = (struct teesmc32_arg *)regs[1];
+			rpc_arg->ret = 0;
+			break;
+		case TEESMC_RETURN_RPC_CMD_REGS:
+			regs[1] = 0;	/* Return value of the request */
+			break;
+		case TEESMC_RETURN_RPC_IRQ:
+			/* Only bench_irq_arm() raises IRQs */
+			write_cntp_ctl(0);
+			s->num_irqs++;
+			break;
+		default:
+			break;
+		}
+		regs[0] = TEESMC32_CALL_RETURN_FROM_RPC;
+	}
+}
+
+static void bench_stats_add(struct bench_stats *s, uint32_t cycles)
+{
+	if (!s->num_calls || cycles < s->min_cycles)
+		s->min_cycles = cycles;
+	if (cycles > s->max_cycles)
+		s->max_cycles = cycles;
+	s->cycles += cycles;
+	s->num_calls++;
+}
+
+static void bench_irq_init(void)
+{
+	vaddr_t gicc = GIC_BASE + GICC_OFFSET;
+	vaddr_t gicd = GIC_BASE + GICD_OFFSET;
+
+	write_cntp_ctl(0);
+	write8(0xa0, gicd + BENCH_GICD_IPRIORITYR + BENCH_IT_NS_PHY_TIMER);
+	write32(1 << BENCH_IT_NS_PHY_TIMER, gicd + BENCH_GICD_ISENABLER(0));
+	write32(0xff, gicc + BENCH_GICC_PMR);
+	write32(read32(gicc + BENCH_GICC_CTLR) | 1, gicc + BENCH_GICC_CTLR);
+}
+
+/* Makes an IRQ pending, it's taken once a thread runs in secure world */
+static void bench_irq_arm(void)
+{
+	write_cntp_tval(0);
+	write_cntp_ctl(CNTP_CTL_ENABLE);
+}
+
+static void bench_run_irq(struct bench_stats *s, uint32_t a0, uint32_t a1,
+		uint32_t a2, uint32_t a3, bool irq)
+{
+	const char *name = s->name;
+	uint32_t start;
+	size_t n;
+
+	memset(s, 0, sizeof(*s));
+	s->name = name;
+	for (n = 0; n < BENCH_LOOPS; n++) {
+		if (irq)
+			bench_irq_arm();
+		start = read_pmccntr();
+		bench_call(s, a0, a1, a2, a3);
+		bench_stats_add(s, read_pmccntr() - start);
+	}
+}
+
+static void bench_run(struct bench_stats *s, uint32_t a0, uint32_t a1,
+		uint32_t a2, uint32_t a3)
+{
+	bench_run_irq(s, a0, a1, a2, a3, false);
+}
+
+/*
+ * Times a byte looped back on the secure console until the FIQ handler
+ * in secure world has drained it, normal world keeps running meanwhile.
+ */
+static void bench_run_fiq(struct bench_stats *s)
+{
+	const char *name = s->name;
+	uint32_t cr = read32(UART1_BASE + BENCH_UART_CR);
+	uint32_t start;
+	size_t n;
+
+	memset(s, 0, sizeof(*s));
+	s->name = name;
+	write32(cr | BENCH_UART_CR_LPE, UART1_BASE + BENCH_UART_CR);
+	for (n = 0; n < BENCH_LOOPS; n++) {
+		start = read_pmccntr();
+		write32(0, UART1_BASE + BENCH_UART_DR);
+		while (read32(UART1_BASE + BENCH_UART_FR) & BENCH_UART_FR_BUSY)
+			;
+		while (!(read32(UART1_BASE + BENCH_UART_FR) &
+			 BENCH_UART_FR_RXFE))
+			;
+		bench_stats_add(s, read_pmccntr() - start);
+	}
+	write32(cr, UART1_BASE + BENCH_UART_CR);
+}
+
+/* Stdcalls on one CPU during an SMP run, returns the number done */
+static uint32_t bench_smp_calls_run(size_t pos, uint32_t start)
+{
+	struct bench_stats s;
+	uint32_t *arg = bench_smp_arg[pos];
+	uint32_t n;
+
+	/* Each CPU needs its own copy as secure world updates it */
+	for (n = 0; n < BENCH_ARG_WORDS; n++)
+		arg[n] = bench_arg[n];
+	memset(&s, 0, sizeof(s));
+	n = 0;
+	while (!bench_smp_stop) {
+		bench_call(&s, TEESMC32_CALL_WITH_ARG, (uint32_t)arg, 0, 0);
+		n++;
+		/* The primary CPU times the run */
+		if (!pos && read_pmccntr() - start >= BENCH_SMP_CYCLES)
+			bench_smp_stop = 1;
+	}
+	return n;
+}
+
+void bench_secondary(size_t pos)
+{
+	uint32_t gen = 0;
+
+	bench_smp_online[pos] = 1;
+	while (true) {
+		while (bench_smp_gen == gen)
+			;
+		gen = bench_smp_gen;
+		if (pos < bench_smp_num_cpus)
+			bench_smp_calls[pos] = bench_smp_calls_run(pos, 0);
+		bench_smp_done[pos] = gen;
+	}
+}
+
+/*
+ * Stdcall throughput with 1 up to NUM_CPUS CPUs issuing the stdcall in
+ * bench_arg concurrently.
+ */
+static void bench_smp(void)
+{
+	uint32_t start = read_pmccntr();
+	size_t num_cpus = 1;
+	uint32_t calls;
+	size_t n;
+
+	while (num_cpus < NUM_CPUS &&
+	       read_pmccntr() - start < BENCH_SMP_BOOT_CYCLES) {
+		if (bench_smp_online[num_cpus])
+			num_cpus++;
+	}
+	if (num_cpus < NUM_CPUS)
+		kprintf("Only %zu of %u CPUs online\n", num_cpus, NUM_CPUS);
+
+	for (bench_smp_num_cpus = 1; bench_smp_num_cpus <= num_cpus;
+	     bench_smp_num_cpus++) {
+		bench_smp_stop = 0;
+		bench_smp_gen++;
+		start = read_pmccntr();
+		calls = bench_smp_calls_run(0, start);
+		for (n = 1; n < num_cpus; n++) {
+			while (bench_smp_done[n] != bench_smp_gen)
+				;
+			if (n < bench_smp_num_cpus)
+				calls += bench_smp_calls[n];
+		}
+		kprintf("stdcall invoke on %u cpus %8u calls in %u cycles\n",
+			bench_smp_num_cpus, calls, BENCH_SMP_CYCLES);
+	}
+}
+
+static void bench_print(const struct bench_stats *s)
+{
+	kprintf("%-24s min %8u avg %8u max %8u rpcs %6u irqs %6u\n", s->name,
+		s->min_cycles, (uint32_t)(s->cycles / s->num_calls),
+		s->max_cycles, s->num_rpcs, s->num_irqs);
+}
+
+void bench_main(void)
+{
+	struct teesmc32_arg *arg = (struct teesmc32_arg *)bench_arg;
+	union teesmc32_param *params = TEESMC32_GET_PARAMS(arg);
+	struct bench_stats s;
+
+	uart_init(UART0_BASE);
+	kprintf_init((kvprintf_putc)uart_putc,
+		(kprintf_flush_output)uart_flush_tx_fifo, (void *)UART0_BASE);
+
+	write_pmcr(read_pmcr() | PMCR_E);
+	write_pmcntenset(PMCNTENSET_C);
+	bench_irq_init();
+
+	kprintf("SMC round trip in cycles, %u loops\n", BENCH_LOOPS);
+
+	/* Register only fastcall, the monitor and thread entry overhead */
+	s.name = "fastcall calls uid";
+	bench_run(&s, TEESMC32_CALLS_UID, 0, 0, 0);
+	bench_print(&s);
+
+	/* Stdcall completed without RPC */
+	memset(bench_arg, 0, sizeof(bench_arg));
+	arg->cmd = TEESMC_CMD_OPEN_SESSION;
+	s.name = "stdcall";
+	bench_run(&s, TEESMC32_CALL_WITH_ARG, (uint32_t)arg, 0, 0);
+	bench_print(&s);
+
+	/* Fast invoke served on the tmp stack in the last opened session */
+	arg->cmd = TEESMC_CMD_INVOKE_COMMAND;
+	arg->ta_func = BENCH_FAST_FUNC_ADD;
+	arg->num_params = 1;
+	params[0].value.a = 1;
+	params[0].value.b = 2;
+	s.name = "fastcall invoke";
+	bench_run(&s, TEESMC32_FASTCALL_WITH_ARG, (uint32_t)arg, 0, 0);
+	bench_print(&s);
+
+	/* Stdcall doing thread_rpc_cmd_regs() */
+	s.name = "stdcall invoke with rpc";
+	bench_run(&s, TEESMC32_CALL_WITH_ARG, (uint32_t)arg, 0, 0);
+	bench_print(&s);
+
+	/* Throughput of the same stdcall issued from several CPUs */
+	bench_smp();
+
+	/* Same with an IRQ forwarded to normal world first */
+	s.name = "stdcall invoke with irq";
+	bench_run_irq(&s, TEESMC32_CALL_WITH_ARG, (uint32_t)arg, 0, 0, true);
+	bench_print(&s);
+
+	/*
+	 * Three value parameters to send back don't fit in registers, the
+	 * RPC needs a struct teesmc32_arg. It's allocated by normal world
+	 * with two more RPCs until the pool is registered.
+	 */
+	arg->num_params = BENCH_MAX_PARAMS;
+	memset(params + 1, 0, (BENCH_MAX_PARAMS - 1) * sizeof(*params));
+	memset(params + BENCH_MAX_PARAMS, TEESMC_ATTR_TYPE_VALUE_INOUT,
+	       BENCH_MAX_PARAMS);
+	s.name = "stdcall invoke arg rpc";
+	bench_run(&s, TEESMC32_CALL_WITH_ARG, (uint32_t)arg, 0, 0);
+	bench_print(&s);
+
+	s.name = "register rpc pool";
+	if (bench_call(&s, TEESMC32_FASTCALL_REGISTER_RPC_POOL,
+		       (uint32_t)bench_rpc_pool, sizeof(bench_rpc_pool), 0) !=
+	    TEESMC_RETURN_OK)
+		kprintf("RPC pool not registered\n");
+	s.name = "stdcall invoke pool rpc";
+	bench_run(&s, TEESMC32_CALL_WITH_ARG, (uint32_t)arg, 0, 0);
+	bench_print(&s);
+
+	/* FIQ raised in normal world and served by secure world */
+	s.name = "forwarded fiq";
+	bench_run_fiq(&s);
+	bench_print(&s);
+
+	/* Cycle and latency statistics of secure world go to its console */
+	s.name = "print stats";
+	bench_call(&s, TEESMC32_FASTCALL_PRINT_STATS, 0, 0, 0);
+
+	kprintf("Benchmark done\n");
+}
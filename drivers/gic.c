@@ -27,7 +27,7 @@
 #include <drivers/gic.h>
 #include <io.h>
 #include <kern/mmu.h>
-#include <kprintf.h>
+#include <trace.h>
 
 #include <assert.h>
 
@@ -95,6 +95,17 @@ out:
 	return ret;
 }
 
+void gic_cpu_init(void)
+{
+	/* SGIs and PPIs are banked per CPU */
+	write32(0xffffffff, gic.gicd_base + GICD_ICENABLER(0));
+	write32(0xffffffff, gic.gicd_base + GICD_ICPENDR(0));
+	write32(0xffffffff, gic.gicd_base + GICD_IGROUPR(0));
+
+	write32(GICC_CTLR_ENABLEGRP0 | GICC_CTLR_ENABLEGRP1 | GICC_CTLR_FIQEN,
+		gic.gicc_base + GICC_CTLR);
+}
+
 void gic_init(vaddr_t gicc_base, vaddr_t gicd_base)
 {
 	size_t n;
@@ -115,8 +126,7 @@ void gic_init(vaddr_t gicc_base, vaddr_t gicd_base)
 	}
 
 	/* Enable GIC */
-	write32(GICC_CTLR_ENABLEGRP0 | GICC_CTLR_ENABLEGRP1 | GICC_CTLR_FIQEN,
-		gic.gicc_base + GICC_CTLR);
+	gic_cpu_init();
 	write32(GICD_CTLR_ENABLEGRP0 | GICD_CTLR_ENABLEGRP1,
 		gic.gicd_base + GICD_CTLR);
 }
@@ -151,10 +161,10 @@ void gic_it_set_cpu_mask(size_t it, uint8_t cpu_mask)
 	target = read32(gic.gicd_base + GICD_ITARGETSR(it / 4));
 	target &= ~(0xff << ((it % 4) * 8));
 	target |= cpu_mask << ((it % 4) * 8);
-	kprintf("cpu_mask: writing 0x%x to 0x%x\n",
+	DMSG("cpu_mask: writing 0x%x to 0x%x\n",
 		target, gic.gicd_base + GICD_ITARGETSR(it / 4));
 	write32(target, gic.gicd_base + GICD_ITARGETSR(it / 4));
-	kprintf("cpu_mask: 0x%x\n",
+	DMSG("cpu_mask: 0x%x\n",
 		read32(gic.gicd_base + GICD_ITARGETSR(it / 4)));
 }
 
@@ -168,7 +178,7 @@ void gic_it_set_prio(size_t it, uint8_t prio)
 	assert(!(read32(gic.gicd_base + GICD_IGROUPR(idx)) & mask));
 
 	/* Set prio it to selected CPUs */
-	kprintf("prio: writing 0x%x to 0x%x\n",
+	DMSG("prio: writing 0x%x to 0x%x\n",
 		prio, gic.gicd_base + GICD_IPRIORITYR(0) + it);
 	write8(prio, gic.gicd_base + GICD_IPRIORITYR(0) + it);
 }
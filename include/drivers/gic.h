@@ -28,7 +28,12 @@
 #define GIC_H
 #include <sys/types.h>
 
+/* Interrupt ID part of the value returned by gic_read_iar() */
+#define GICC_IAR_IT_ID_MASK	0x3ff
+
 void gic_init(paddr_t gicc_base, paddr_t gicd_base);
+/* Initializes the CPU interface of a secondary CPU after gic_init() */
+void gic_cpu_init(void);
 
 void gic_it_add(size_t it);
 void gic_it_set_cpu_mask(size_t it, uint8_t cpu_mask);
@@ -40,6 +40,12 @@ void resmem_init(uintptr_t begin, uintptr_t end);
  */
 void *resmem_alloc(size_t size);
 
+/*
+ * Same as resmem_alloc but the returned pointer is aligned to align
+ * which has to be a power of 2.
+ */
+void *resmem_alloc_aligned(size_t size, size_t align);
+
 /* Makes all further calls to resmem_alloc fail */
 void resmem_disable(void);
 
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2014, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <kprintf.h>
+
+/*
+ * Trace levels, a message is printed if its level is at or below the
+ * threshold of the module. Messages above the threshold are compiled
+ * out completely, the condition is a constant so not even the format
+ * string is kept while the arguments are still type checked.
+ */
+#define TRACE_ERROR	1
+#define TRACE_INFO	2
+#define TRACE_DEBUG	3
+#define TRACE_FLOW	4
+
+/*
+ * TRACE_LEVEL is the global threshold from conf.mk, a directory can
+ * override it with -DTRACE_MODULE_LEVEL=<level> in cppflags-y of its
+ * sub.mk.
+ */
+#if defined(TRACE_MODULE_LEVEL)
+#define TRACE_THRESHOLD		TRACE_MODULE_LEVEL
+#elif defined(TRACE_LEVEL)
+#define TRACE_THRESHOLD		TRACE_LEVEL
+#else
+#define TRACE_THRESHOLD		TRACE_ERROR
+#endif
+
+#define trace_printf(level, ...)					\
+	do {								\
+		if ((level) <= TRACE_THRESHOLD)				\
+			kprintf(__VA_ARGS__);				\
+	} while (0)
+
+#define EMSG(...)	trace_printf(TRACE_ERROR, __VA_ARGS__)
+#define IMSG(...)	trace_printf(TRACE_INFO, __VA_ARGS__)
+#define DMSG(...)	trace_printf(TRACE_DEBUG, __VA_ARGS__)
+#define FMSG(...)	trace_printf(TRACE_FLOW, __VA_ARGS__)
+
+#endif /*TRACE_H*/
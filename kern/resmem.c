@@ -62,6 +62,22 @@ void *resmem_alloc(size_t size)
 	return (void *)old_begin;
 }
 
+void *resmem_alloc_aligned(size_t size, size_t align)
+{
+	uintptr_t old_begin = resmem.begin;
+	uintptr_t begin = ROUNDUP(resmem.begin, align);
+	void *p;
+
+	if (resmem.disabled || begin < resmem.begin || begin > resmem.end)
+		return NULL;
+
+	resmem.begin = begin;
+	p = resmem_alloc(size);
+	if (!p)
+		resmem.begin = old_begin;
+	return p;
+}
+
 void resmem_disable(void)
 {
 	resmem.disabled = true;